@@ -14,12 +14,39 @@
 #include <unordered_map>
 #include <sstream>
 #include <algorithm>
+#include <cctype>
 #include <iostream>
 #include <vector>
 #include <future>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <exception>
+#include <utility>
 
 #include <curl/curl.h>
 
+// c++20 coroutine api, c++11 builds leave it out
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define HTTP_HAS_COROUTINE 1
+#endif
+#endif
+
+// std::pmr arenas, opt in with HTTP_USE_PMR on a c++17 library
+#if defined(HTTP_USE_PMR) && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#endif
+#if defined(__cpp_lib_memory_resource)
+#define HTTP_HAS_PMR 1
+#endif
+#endif
+
 namespace http {
 
 
@@ -50,6 +77,42 @@ namespace http {
 	ClassWrapper(URL, std::string)
 	ClassWrapper(Progress, std::function<void(double)>)
 	ClassWrapper(Payload, std::string)
+	// the request fails with ErrorCode::deadline once the time point passes, time queued in the engine included
+	ClassWrapper(Deadline, std::chrono::steady_clock::time_point)
+	// body chunks as they arrive instead of Response::body_, nothing is buffered,
+	// returning false stops the transfer with ErrorCode::stopped
+	ClassWrapper(OnData, std::function<bool(const char*, size_t)>)
+	// the request fails with ErrorCode::too_large past the limit, a body as soon as the
+	// Content-Length of the final response says so, 0 for no limit
+	ClassWrapper(MaxBodyBytes, size_t)
+	ClassWrapper(MaxHeaderBytes, size_t)
+#ifdef HTTP_HAS_PMR
+	// scratch strings and response headers of the session come from the arena,
+	// responses must go before the arena is released
+	ClassWrapper(Arena, std::pmr::memory_resource*)
+#endif
+
+	// scheduling class of an async request, queued requests are started by
+	// weighted round robin over the classes, see EngineConfig::priority_weights_
+	enum class Priority
+	{
+		high,
+		normal,
+		low,
+	};
+
+#define HTTP_PRIORITY_COUNT 3
+
+	enum class HttpVersion
+	{
+		// curl's default
+		any,
+		http1_1,
+		// http/2 over tls, http/1.1 for plain http
+		http2,
+		// h2c without the upgrade, the server must speak http/2 on plain http
+		http2_prior_knowledge,
+	};
 	
 
 	using byte_t = unsigned char;
@@ -78,6 +141,10 @@ namespace http {
 		Headers(std::string& header_string);
 		Headers(std::unordered_map<std::string, std::string>& map);
 		Headers(const std::initializer_list<Field>& headers);
+#ifdef HTTP_HAS_PMR
+		// the fields are allocated from arena
+		Headers(std::string& header_string, std::pmr::memory_resource* arena);
+#endif
 
 		// field
 
@@ -86,13 +153,13 @@ namespace http {
 			
 			// avoid inserting a null value
 			T t{};
-			auto itr = _storage_headers.find(field);
+			auto itr = _storage_headers.find(__string_t(field.data(), field.size()));
 			if (itr == _storage_headers.end())
 			{
 				return t;
 			}
 
-			std::istringstream stream(itr->second);
+			std::istringstream stream(std::string(itr->second.data(), itr->second.size()));
 			stream >> t;
 			return HTTP_MOVE(t);
 		};
@@ -102,33 +169,33 @@ namespace http {
 		std::string GetField(std::string field) {
 
 			// avoid inserting a null value
-			auto itr = _storage_headers.find(field);
+			auto itr = _storage_headers.find(__string_t(field.data(), field.size()));
 			if (itr == _storage_headers.end())
 			{
 				return "";
 			}
 
-			return _storage_headers[field];
+			return std::string(itr->second.data(), itr->second.size());
 		};
 
 		template <>
 		bool GetField(std::string field) {
 
 			// avoid inserting a null value
-			auto itr = _storage_headers.find(field);
+			auto itr = _storage_headers.find(__string_t(field.data(), field.size()));
 			if (itr == _storage_headers.end())
 			{
 				return false;
 			}
 
 			// compatible both "0&&1" and "true&&false"
-			if (_storage_headers[field] == "true")
+			if (itr->second == "true")
 			{
 				return true;
 			}
 
 			bool b;
-			std::istringstream stream(itr->second);
+			std::istringstream stream(std::string(itr->second.data(), itr->second.size()));
 			stream >> b;
 			return HTTP_MOVE(b);
 		};
@@ -137,7 +204,8 @@ namespace http {
 		void SetField(std::string field, T value) {
 			std::ostringstream stream;
 			stream << value;
-			_storage_headers[field] = stream.str();
+			auto value_string = stream.str();
+			_storage_headers[__string_t(field.data(), field.size())].assign(value_string.data(), value_string.size());
 
 		};
 
@@ -151,10 +219,39 @@ namespace http {
 
 	private:
 
+#ifdef HTTP_HAS_PMR
+		using __string_t = std::pmr::string;
+		std::pmr::unordered_map<__string_t, __string_t> _storage_headers;
+#else
+		using __string_t = std::string;
 		std::unordered_map<std::string, std::string> _storage_headers;
+#endif
 
 	};
 
+	// why a request has no regular response, error_ holds the message
+	enum class ErrorCode
+	{
+		none,
+		// the transfer failed inside curl
+		curl,
+		// the engine queue was full under QueuePolicy::reject
+		rejected,
+		// pushed out of the engine queue by a newer request under QueuePolicy::drop_oldest
+		dropped,
+		// the engine stopped before the transfer completed
+		aborted,
+		// the CancelToken of the request was cancelled
+		cancelled,
+		// the Deadline of the request passed
+		deadline,
+		// the OnData callback or a BodyWriter returned false, or the body overflowed
+		// a BodySink::Buffer set to BodySink::stop
+		stopped,
+		// the body or the headers went past MaxBodyBytes or MaxHeaderBytes
+		too_large,
+	};
+
 	// response
 	class Response
 	{
@@ -167,9 +264,135 @@ namespace http {
 		std::string body_;
 		Headers headers_;
 		std::string error_;
+		ErrorCode error_code_ = ErrorCode::none;
+		// bytes of the body received, wherever the BodySink put them
+		size_t body_size_ = 0;
+		// the body didn't fit its BodySink::Buffer, body_size_ still counts all of it
+		bool truncated_ = false;
+
+	};
+
+	// body buffer allocations of every session so far, for debugging
+	struct BufferStats
+	{
+		// body buffers reserved from Content-Length, download files preallocated with fallocate (linux)
+		uint64_t presized_;
+		uint64_t preallocated_files_;
+		// body buffer growths while appending, chunked bodies and bodies bigger than HTTP_MAX_PRESIZE
+		uint64_t reallocations_;
+	};
+
+	BufferStats GetBufferStats();
+
+	// ----------------------------------------------------------------------------------
+	//
+	//    BodySink
+	//
+	// ----------------------------------------------------------------------------------
+
+	// the destination of BodySink::Custom
+	class BodyWriter
+	{
+	public:
+		virtual ~BodyWriter() = default;
+
+		// the Content-Length once the headers are in, chunked bodies don't get it
+		virtual void Reserve(size_t /*size*/) {}
+		// false stops the transfer with ErrorCode::stopped
+		virtual bool Write(const char* data, size_t size) = 0;
+	};
+
+	// where the response body goes, set per request like any other option,
+	// the built-in sinks are written without a virtual call
+	class BodySink
+	{
+	public:
+
+		enum Kind
+		{
+			memory,
+			file,
+			buffer,
+			discard,
+			tee,
+			custom,
+		};
+
+		// what a Buffer sink does with the bytes past its capacity
+		enum Overflow
+		{
+			// dropped, the transfer goes on
+			truncate,
+			// the transfer fails with ErrorCode::stopped
+			stop,
+		};
+
+		// Response::body_, the default
+		BodySink() = default;
+
+		static BodySink Memory();
+		// the file is truncated when the option is set, the same as DownloadFilePath
+		static BodySink File(std::string path);
+		// the body is written straight into data, nothing is allocated for it,
+		// Response::truncated_ tells when it didn't fit
+		static BodySink Buffer(char* data, size_t capacity, Overflow overflow = truncate);
+		// counted and dropped, for HEAD requests and health checks
+		static BodySink Discard();
+		// every chunk goes to both, either one stopping stops the transfer
+		static BodySink Tee(BodySink first, BodySink second);
+		static BodySink Custom(std::shared_ptr<BodyWriter> writer);
+
+		Kind GetKind() const { return _kind; }
+
+	private:
+
+		friend struct __write_data_t;
+
+		Kind _kind = memory;
+		std::string _path;
+		char* _data = nullptr;
+		size_t _capacity = 0;
+		Overflow _overflow = truncate;
+		std::shared_ptr<const BodySink> _first;
+		std::shared_ptr<const BodySink> _second;
+		std::shared_ptr<BodyWriter> _writer;
+	};
+
+	// ----------------------------------------------------------------------------------
+	//
+	//    BufferPool
+	//
+	// ----------------------------------------------------------------------------------
+
+	// memory sink bodies of every session come from the pool once it is on,
+	// in size classes of powers of two from 1KB to 4MB
+	struct BufferPoolConfig
+	{
+		// bytes kept for reuse over all threads, 0 turns the pool off
+		size_t max_retained_bytes_ = 0;
+		// buffers of each size class a thread keeps without taking the lock
+		size_t thread_cache_buffers_ = 4;
+	};
 
+	struct BufferPoolStats
+	{
+		// bodies that started in a recycled buffer, and in a new one
+		uint64_t hits_;
+		uint64_t misses_;
+		// buffers taken back, and the ones let go over the cap or the largest class
+		uint64_t recycled_;
+		uint64_t dropped_;
+		uint64_t retained_bytes_;
 	};
 
+	// turning the pool off frees the shared buffers and the ones cached by the calling thread
+	void SetBufferPool(const BufferPoolConfig& config);
+	BufferPoolStats GetBufferPoolStats();
+
+	// the body buffer goes back to the pool, the body is left empty
+	void Recycle(Response&& resp);
+	void Recycle(std::string&& body);
+
 
 	// ----------------------------------------------------------------------------------
 	//
@@ -241,16 +464,171 @@ namespace http {
 	};
 
 
+	// ----------------------------------------------------------------------------------
+	//
+	//    Share
+	//
+	// ----------------------------------------------------------------------------------
+
+	// lock counters of one curl_lock_data
+	struct ShareLockStats
+	{
+		uint64_t acquired_;
+		// acquisitions that had to wait
+		uint64_t contended_;
+		uint64_t wait_ns_;
+	};
+
+	// dns cache, tls sessions and connections shared by every attached handle,
+	// guarded by one reader/writer lock per curl_lock_data
+	class Share
+	{
+	public:
+
+		// connections: also share the connection cache
+		Share(bool connections = true);
+		~Share();
+
+		Share(const Share&) = delete;
+		Share& operator=(const Share&) = delete;
+
+		// the process-wide share used by the default pool
+		static Share& Default();
+
+		CURLSH* Handle();
+
+		ShareLockStats LockStats(curl_lock_data data);
+
+	private:
+
+		// curl lock callbacks
+		static void __lock(CURL *curl, curl_lock_data data, curl_lock_access access, void *userptr);
+		static void __unlock(CURL *curl, curl_lock_data data, void *userptr);
+
+	private:
+
+		CURLSH *_share;
+
+		std::shared_ptr<struct __share_lock_t> _locks;
+	};
+
+	// ----------------------------------------------------------------------------------
+	//
+	//    Pool
+	//
+	// ----------------------------------------------------------------------------------
+
+	// thread-safe pool of warm curl handles,
+	// an idle handle keeps its keep-alive connections so the next request can reuse them
+	class Pool
+	{
+	public:
+
+		Pool(size_t max_total = 64, size_t max_per_host = 8, long idle_timeout_ms = 60000);
+		~Pool();
+
+		// the process-wide pool behind http::Get/Post/Head
+		static Pool& Default();
+
+		// limits
+		void SetMaxTotal(size_t max_total);
+		void SetMaxPerHost(size_t max_per_host);
+		void SetIdleTimeout(long idle_timeout_ms);
+
+		// attach every handle to the share, the share must outlive the pool
+		void SetShare(Share* share);
+
+		// close every idle handle and its connections
+		void Clear();
+
+		// both close the idle handles past the idle timeout first
+		size_t IdleCount();
+		size_t InUseCount();
+
+	private:
+
+		friend class Session;
+
+		// handle
+		CURLHandle* __acquire();
+		void __release(CURLHandle* handle);
+
+		// per host in flight slot, taken before the handle so a session waiting for a busy host
+		// holds none and every live handle counts against max_total
+		void __acquire_host(const std::string& host);
+		void __release_host(const std::string& host);
+
+		void __attach_share(CURLHandle* handle);
+
+		// move expired idle handles into the given list, lock must be held
+		void __collect_expired(std::vector<CURLHandle*>& expired);
+
+	private:
+
+		using clock_t = std::chrono::steady_clock;
+
+		size_t _max_total;
+		size_t _max_per_host;
+		long _idle_timeout_ms;
+
+		Share* _share;
+
+		std::mutex _mutex;
+		std::condition_variable _handle_cond;
+		std::condition_variable _host_cond;
+
+		size_t _in_use;
+		// most recently released at the back
+		std::vector<std::pair<CURLHandle*, clock_t::time_point>> _idle;
+		std::unordered_map<std::string, size_t> _host_in_flight;
+	};
+
+	// ----------------------------------------------------------------------------------
+	//
+	//    CancelToken
+	//
+	// ----------------------------------------------------------------------------------
+
+	// passed as an option, copies share the state so one token can cancel many requests
+	class CancelToken
+	{
+	public:
+
+		CancelToken();
+
+		// abort the requests holding the token, the ones not started yet fail at once,
+		// a sync request notices it in its progress callback
+		void Cancel();
+		bool Cancelled() const;
+
+	private:
+
+		friend class Session;
+
+		std::shared_ptr<struct __cancel_state_t> _state;
+	};
+
 	// ----------------------------------------------------------------------------------
 	//
 	//    Session
 	//
 	// ----------------------------------------------------------------------------------
+
+	enum class Method
+	{
+		get,
+		post,
+		head,
+	};
+
 	class Session
 	{
 	public:
 
 		Session();
+		// borrow a warm handle from the pool for each request, once its host has a free slot,
+		// it goes back when the response is read
+		Session(Pool& pool);
 
 		// options
 		void SetOption(URL& url);
@@ -260,12 +638,36 @@ namespace http {
 		void SetOption(Progress& progress);
 		void SetOption(Multipart& multipart);
 		void SetOption(Payload& payload);
+		// kept by Reset(), the share must outlive the session
+		void SetOption(Share& share);
+		// only the async engine schedules by priority
+		void SetOption(Priority& priority);
+		void SetOption(HttpVersion& version);
+		void SetOption(CancelToken& token);
+		void SetOption(Deadline& deadline);
+		void SetOption(OnData& on_data);
+		void SetOption(BodySink& sink);
+		void SetOption(MaxBodyBytes& max_body_bytes);
+		void SetOption(MaxHeaderBytes& max_header_bytes);
+#ifdef HTTP_HAS_PMR
+		void SetOption(Arena& arena);
+#endif
 
 		// method
 		Response Get();
 		Response Post();
 		Response Head();
 
+		// lifecycle
+		// clear request scoped state (url, parameters, headers, payload, multipart, download, progress,
+		// priority, cancel token, deadline, http version, on data, body sink, size limits, arena),
+		// the curl handle and its live connections are kept, the body went to the last response
+		void Reset();
+
+		// reset then set the options of the next request
+		template <typename... Ts>
+		void Prepare(Ts&&... ts);
+
 	private:
 
 		// options
@@ -276,12 +678,39 @@ namespace http {
 		void __set_progress(Progress& progress);
 		void __set_multipart(Multipart& multipart);
 		void __set_payload(Payload& payload);
+		void __set_share(Share& share);
+		void __set_priority(Priority& priority);
+		void __set_http_version(HttpVersion& version);
+		void __set_cancel_token(CancelToken& token);
+		void __set_deadline(Deadline& deadline);
+		void __set_on_data(OnData& on_data);
+		void __set_body_sink(BodySink& sink);
+		void __set_max_body_bytes(MaxBodyBytes& max_body_bytes);
+		void __set_max_header_bytes(MaxHeaderBytes& max_header_bytes);
+#ifdef HTTP_HAS_PMR
+		void __set_arena(Arena& arena);
+#endif
+
+		// the cancel token or the deadline stops the request before it starts
+		bool __stopped(ErrorCode& code);
+
+		// method
+		void __set_method(Method method);
 
 		// core request
-		Response __request(CURL *curl);
+		Response __request();
+		// the deadline of a transfer curl runs on its own
+		void __set_timeout(CURL *curl);
+		// request split for the async engine, __prepare before the transfer and __response after it,
+		// __prepare puts every option on the handle
+		void __prepare(CURL *curl);
+		Response __response(CURL *curl, CURLcode res);
+
+		// curl defaults
+		void __set_defaults(CURL *curl);
 
 		// curl life manager
-		CURLHandle* __curl_handle_init();
+		static CURLHandle* __curl_handle_init();
 		static void __curl_handle_free(CURLHandle* handle);
 
 		// resp custom deleter
@@ -289,24 +718,57 @@ namespace http {
 
 		// curl write callback
 		static size_t __write_function(void* ptr, size_t size, size_t nmemb, struct __write_data_t *data);
+		// curl header callback, presizes the body from Content-Length
+		static size_t __header_function(char* ptr, size_t size, size_t nmemb, struct __write_data_t *data);
 		// curl progress callback
 		static int __xfer_info(void *data, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
 
 	private:
 
+		friend class Pool;
+		friend class Engine;
+		friend class Batch;
+		friend class Reactor;
+		friend struct __engine_t;
+		friend struct __loop_t;
+		friend struct __reactor_t;
+
 		URL _url;
 
 		Parameters _parameters;
 
 		Progress _progress;
 
+		Priority _priority;
+		// the engine only waits for a connection that may multiplex
+		HttpVersion _http_version = HttpVersion::any;
+
+		std::shared_ptr<struct __cancel_state_t> _cancel;
+		Deadline _deadline;
+
+#ifdef HTTP_HAS_PMR
+		std::pmr::memory_resource* _arena = nullptr;
+#endif
+
+		// kept here until __prepare, a session on a pool has no handle between requests
+		Method _method = Method::get;
+		Headers _headers;
+		std::unique_ptr<Multipart> _multipart;
+		std::unique_ptr<std::string> _payload;
+		Share* _share = nullptr;
+
+		Pool* _pool;
+
 		std::unique_ptr<CURLHandle, std::function<void(CURLHandle *)>> _curl_handle_ptr;
 		std::shared_ptr<struct __write_data_t> _response_data_ptr;
+		std::shared_ptr<struct __write_data_t> _header_data_ptr;
 	};
 
 	// private
 	namespace priv {
 
+		inline void __set_option(Session&) {}
+
 		template <typename T>
 		void __set_option(Session& session, T&& t)
 		{
@@ -320,8 +782,564 @@ namespace http {
 			__set_option(session, HTTP_FWD(ts)...);
 		}
 
+		// the url among the options, empty without one
+		inline std::string __find_url() { return ""; }
+
+		template <typename... Ts>
+		std::string __find_url(const URL& url, const Ts&...) { return url.value_; }
+
+		template <typename T, typename... Ts>
+		std::string __find_url(const T&, const Ts&... ts) { return __find_url(ts...); }
+
+		// the type std::bind passes a bound option as, a std::ref is unwrapped
+		template <typename T>
+		struct __unwrap_option { using type = T; };
+
+		template <typename T>
+		struct __unwrap_option<std::reference_wrapper<T>> { using type = T; };
+
+		template <typename T>
+		struct __bound_option : __unwrap_option<typename std::decay<T>::type> {};
+
+		// target of std::bind, the bound copies are passed as lvalues
+		template <typename... Ts>
+		void __apply_options(Session& session, Ts&... ts)
+		{
+			__set_option(session, ts...);
+		}
+
 	} // namespace priv
 
+	template <typename... Ts>
+	void Session::Prepare(Ts&&... ts)
+	{
+		Reset();
+		priv::__set_option(*this, HTTP_FWD(ts)...);
+	}
+
+	// ----------------------------------------------------------------------------------
+	//
+	//    Future
+	//
+	// ----------------------------------------------------------------------------------
+
+	// shared state of a Future, no std::future machinery, one continuation at most
+	struct __future_state_base_t
+	{
+		std::mutex mutex_;
+		std::condition_variable cond_;
+		bool ready_ = false;
+		std::exception_ptr exception_;
+		std::function<void()> continuation_;
+
+		// run the continuation now if the value is there, otherwise when it arrives
+		void OnReady(std::function<void()> continuation) {
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				if (!ready_)
+				{
+					continuation_ = HTTP_MOVE(continuation);
+					return;
+				}
+			}
+			continuation();
+		};
+
+		void Wait() {
+			std::unique_lock<std::mutex> lock(mutex_);
+			cond_.wait(lock, [this] { return ready_; });
+		};
+
+		bool Ready() {
+			std::lock_guard<std::mutex> lock(mutex_);
+			return ready_;
+		};
+
+		void SetException(std::exception_ptr exception) {
+			exception_ = exception;
+			__set_ready();
+		};
+
+		void __set_ready() {
+			std::function<void()> continuation;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				ready_ = true;
+				continuation.swap(continuation_);
+			}
+			cond_.notify_all();
+
+			if (continuation)
+			{
+				continuation();
+			}
+		};
+	};
+
+	template <typename T>
+	struct __future_state_t : __future_state_base_t
+	{
+		T value_{};
+
+		void SetValue(T value) {
+			value_ = HTTP_MOVE(value);
+			__set_ready();
+		};
+	};
+
+	template <>
+	struct __future_state_t<void> : __future_state_base_t
+	{
+		void SetValue() {
+			__set_ready();
+		};
+	};
+
+	// call a continuation with the value of a ready state
+	template <typename T>
+	struct __future_apply
+	{
+		template <typename F>
+		static auto Call(F& f, __future_state_t<T>& state) -> decltype(f(std::declval<T>())) {
+			return f(HTTP_MOVE(state.value_));
+		}
+	};
+
+	template <>
+	struct __future_apply<void>
+	{
+		template <typename F>
+		static auto Call(F& f, __future_state_t<void>& state) -> decltype(f()) {
+			return f();
+		}
+	};
+
+	// store the result of a continuation into the next state
+	template <typename U>
+	struct __future_chain
+	{
+		template <typename F, typename T>
+		static void Run(__future_state_t<U>& next, F& f, __future_state_t<T>& state) {
+			next.SetValue(__future_apply<T>::Call(f, state));
+		}
+	};
+
+	template <>
+	struct __future_chain<void>
+	{
+		template <typename F, typename T>
+		static void Run(__future_state_t<void>& next, F& f, __future_state_t<T>& state) {
+			__future_apply<T>::Call(f, state);
+			next.SetValue();
+		}
+	};
+
+	template <typename T>
+	struct __future_result
+	{
+		template <typename F>
+		static auto Of(F& f) -> decltype(f(std::declval<T>()));
+	};
+
+	template <>
+	struct __future_result<void>
+	{
+		template <typename F>
+		static auto Of(F& f) -> decltype(f());
+	};
+
+	// a single consumer future, Get() or Then() takes the value
+	template <typename T>
+	class Future
+	{
+	public:
+
+		Future() = default;
+		explicit Future(std::shared_ptr<__future_state_t<T>> state) : _state(HTTP_MOVE(state)) {}
+
+		// a default constructed or moved from future has no state, it is never ready
+		// and Wait(), Get() and Then() throw std::future_error(no_state)
+		bool Valid() const { return _state != nullptr; }
+		bool Ready() { return _state && _state->Ready(); }
+		void Wait() { __check(); _state->Wait(); }
+
+		// block until the value is there
+		T Get();
+
+		// the continuation runs on the thread that completes this future,
+		// or right away when it is ready already
+		template <typename F>
+		auto Then(F f) -> Future<decltype(__future_result<T>::Of(f))>;
+
+	private:
+
+		template <typename U>
+		friend class Future;
+
+		template <typename U>
+		friend Future<std::vector<U>> WhenAll(std::vector<Future<U>> futures);
+
+		template <typename U>
+		friend Future<std::pair<size_t, U>> WhenAny(std::vector<Future<U>> futures);
+
+		void __check() const {
+			if (!_state)
+			{
+				throw std::future_error(std::future_errc::no_state);
+			}
+		};
+
+		std::shared_ptr<__future_state_t<T>> _state;
+	};
+
+	template <typename T>
+	T Future<T>::Get()
+	{
+		__check();
+		_state->Wait();
+		if (_state->exception_)
+		{
+			std::rethrow_exception(_state->exception_);
+		}
+		return HTTP_MOVE(_state->value_);
+	}
+
+	template <>
+	inline void Future<void>::Get()
+	{
+		__check();
+		_state->Wait();
+		if (_state->exception_)
+		{
+			std::rethrow_exception(_state->exception_);
+		}
+	}
+
+	template <typename T>
+	template <typename F>
+	auto Future<T>::Then(F f) -> Future<decltype(__future_result<T>::Of(f))>
+	{
+		using U = decltype(__future_result<T>::Of(f));
+		__check();
+
+		auto next = std::make_shared<__future_state_t<U>>();
+		auto state = _state;
+		state->OnReady([state, next, f]() mutable {
+			if (state->exception_)
+			{
+				next->SetException(state->exception_);
+				return;
+			}
+
+			try
+			{
+				__future_chain<U>::Run(*next, f, *state);
+			}
+			catch (...)
+			{
+				next->SetException(std::current_exception());
+			}
+		});
+		return Future<U>(next);
+	}
+
+	// ready when every future is, fails with the first exception,
+	// an invalid future fails it with std::future_error(no_state)
+	template <typename T>
+	Future<std::vector<T>> WhenAll(std::vector<Future<T>> futures)
+	{
+		struct all_t
+		{
+			std::vector<T> values_;
+			std::atomic<size_t> left_;
+			std::mutex mutex_;
+			std::exception_ptr exception_;
+		};
+
+		auto next = std::make_shared<__future_state_t<std::vector<T>>>();
+		if (futures.empty())
+		{
+			next->SetValue(std::vector<T>());
+			return Future<std::vector<T>>(next);
+		}
+
+		auto all = std::make_shared<all_t>();
+		all->values_.resize(futures.size());
+		all->left_.store(futures.size());
+
+		auto fail = [all](std::exception_ptr exception) {
+			std::lock_guard<std::mutex> lock(all->mutex_);
+			if (!all->exception_) all->exception_ = exception;
+		};
+		auto finish = [next, all] {
+			if (all->left_.fetch_sub(1) == 1)
+			{
+				if (all->exception_)
+				{
+					next->SetException(all->exception_);
+				}
+				else
+				{
+					next->SetValue(HTTP_MOVE(all->values_));
+				}
+			}
+		};
+
+		for (size_t i = 0; i < futures.size(); ++i)
+		{
+			auto state = futures[i]._state;
+			if (!state)
+			{
+				fail(std::make_exception_ptr(std::future_error(std::future_errc::no_state)));
+				finish();
+				continue;
+			}
+
+			state->OnReady([state, all, fail, finish, i] {
+				if (state->exception_)
+				{
+					fail(state->exception_);
+				}
+				else
+				{
+					all->values_[i] = HTTP_MOVE(state->value_);
+				}
+				finish();
+			});
+		}
+		return Future<std::vector<T>>(next);
+	}
+
+	// ready with the index and value of the first future that is, invalid futures are skipped,
+	// fails with std::future_error(no_state) without a valid one
+	template <typename T>
+	Future<std::pair<size_t, T>> WhenAny(std::vector<Future<T>> futures)
+	{
+		auto next = std::make_shared<__future_state_t<std::pair<size_t, T>>>();
+		auto done = std::make_shared<std::atomic<bool>>(false);
+
+		if (std::none_of(futures.begin(), futures.end(), [](const Future<T>& future) { return future.Valid(); }))
+		{
+			next->SetException(std::make_exception_ptr(std::future_error(std::future_errc::no_state)));
+			return Future<std::pair<size_t, T>>(next);
+		}
+
+		for (size_t i = 0; i < futures.size(); ++i)
+		{
+			auto state = futures[i]._state;
+			if (!state)
+			{
+				continue;
+			}
+
+			state->OnReady([state, next, done, i] {
+				if (done->exchange(true))
+				{
+					return;
+				}
+
+				if (state->exception_)
+				{
+					next->SetException(state->exception_);
+				}
+				else
+				{
+					next->SetValue(std::make_pair(i, HTTP_MOVE(state->value_)));
+				}
+			});
+		}
+		return Future<std::pair<size_t, T>>(next);
+	}
+
+	// ----------------------------------------------------------------------------------
+	//
+	//    Engine
+	//
+	// ----------------------------------------------------------------------------------
+
+	enum class EngineBackend
+	{
+		// curl_multi_wait, every transfer is rescanned on each wakeup
+		poll,
+		// curl_multi_socket_action on epoll, only ready sockets do work,
+		// linux only, other platforms fall back to poll
+		epoll,
+	};
+
+	// what a submission does when the engine queue is full
+	enum class QueuePolicy
+	{
+		// the submitting thread waits for a free slot
+		block,
+		// the request completes at once with ErrorCode::rejected
+		reject,
+		// the oldest queued request completes with ErrorCode::dropped and makes room
+		drop_oldest,
+	};
+
+	// runs a task on a thread pool, a strand or inline, every task it is given must run
+	using Executor = std::function<void(std::function<void()> task)>;
+
+	struct EngineConfig
+	{
+		// event loop threads, each with its own curl_multi handle and connection cache
+		size_t threads_ = 1;
+		EngineBackend backend_ = EngineBackend::poll;
+		// queued transfers at which a loop counts as behind and idle loops steal from it
+		size_t steal_threshold_ = 8;
+		// transfers on the multi handle of one loop, the rest wait in the queue, 0 for no limit
+		size_t max_transfers_ = 0;
+		// transfers of one origin on the multi handle of one loop, 0 for no limit,
+		// origins queued on a loop take turns so a slow one can't hold every slot
+		size_t max_per_origin_ = 0;
+		// submitted transfers not started yet over all loops, 0 for no limit
+		size_t queue_capacity_ = 0;
+		// under QueuePolicy::drop_oldest the lowest priority class is dropped first
+		QueuePolicy queue_policy_ = QueuePolicy::block;
+		// queued transfers started per round for each Priority class,
+		// a busy class can't starve the lower ones, 0 counts as 1
+		size_t priority_weights_[HTTP_PRIORITY_COUNT] = { 16, 4, 1 };
+		// runs the completions instead of the loop threads, so a slow one can't stall the transfers,
+		// it must outlive the engine, the engine waits for the tasks it gave out when destroyed
+		Executor executor_;
+		// completions of one pass of a loop are handed to the executor together,
+		// at most this many per task, 0 for no limit
+		size_t completion_batch_ = 64;
+		// http/2 requests of one origin share a connection, a request waits for a connection
+		// being set up instead of opening its own, https and h2c only, plain http/1.1 doesn't wait
+		bool multiplex_ = true;
+		// streams on one http/2 connection, more open another connection,
+		// 0 keeps curl's default, needs curl 7.67
+		size_t max_streams_ = 0;
+		// connections to one origin from one loop, more transfers wait in curl for a free stream,
+		// 0 for no limit
+		size_t max_connections_per_origin_ = 0;
+	};
+
+	// queue of one Priority class
+	struct PriorityStats
+	{
+		size_t queued_;
+		// transfers taken off the queue, their total and longest time in it
+		uint64_t dequeued_;
+		uint64_t queue_wait_ns_;
+		uint64_t queue_wait_max_ns_;
+	};
+
+	// the transfers of one origin on the multi handles
+	struct OriginStats
+	{
+		std::string origin_;
+		// connections they use, epoll backend only and 0 on the poll backend, and the transfers themselves,
+		// streams_ / connections_ is the stream utilization of the origin's connections
+		size_t connections_;
+		size_t streams_;
+	};
+
+	struct EngineStats
+	{
+		size_t in_flight_;
+		uint64_t submitted_;
+		uint64_t completed_;
+		// transfers moved to another loop before they started
+		uint64_t stolen_;
+		// queue depth now and at its peak
+		size_t queued_;
+		size_t queued_peak_;
+		// transfers taken off the queue and their total time in it
+		uint64_t dequeued_;
+		uint64_t queue_wait_ns_;
+		// submissions that waited for a slot under QueuePolicy::block and their total wait
+		uint64_t blocked_;
+		uint64_t block_wait_ns_;
+		uint64_t rejected_;
+		uint64_t dropped_;
+		// indexed by Priority
+		PriorityStats priorities_[HTTP_PRIORITY_COUNT];
+		// transfers completed on a multi handle and their total time there
+		uint64_t transferred_;
+		uint64_t transfer_ns_;
+		// callbacks run, their total wait from the end of the transfer, total and longest run time
+		uint64_t delivered_;
+		uint64_t delivery_wait_ns_;
+		uint64_t callback_ns_;
+		uint64_t callback_max_ns_;
+		// tasks given to EngineConfig::executor_
+		uint64_t batches_;
+		// connections of the running transfers, epoll backend only and 0 on the poll backend,
+		// and the transfers on the multi handles, both summed over origins_
+		size_t connections_;
+		size_t streams_;
+		std::vector<OriginStats> origins_;
+		// connections opened by the completed transfers, completed_ / connects_ is the reuse over time,
+		// and completed transfers that ran over http/2
+		uint64_t connects_;
+		uint64_t multiplexed_;
+	};
+
+	// async engine, requests are sharded by origin over event loop threads running curl_multi
+	class Engine
+	{
+	public:
+
+		Engine(const EngineConfig& config = EngineConfig());
+		~Engine();
+
+		Engine(const Engine&) = delete;
+		Engine& operator=(const Engine&) = delete;
+
+		// the engine behind http::GetAsync/PostAsync/HeadAsync
+		static Engine& Default();
+
+		// only before the first submission, returns false once the loops are running
+		bool Configure(const EngineConfig& config);
+
+		// attach every transfer submitted afterwards to the share, the share must outlive the engine
+		void SetShare(Share* share);
+
+		// the completion runs on the loop thread of the request or on EngineConfig::executor_
+		template <typename... Ts>
+		std::future<void> Submit(Method method, std::function<void(Response)> complete, Ts&&... ts);
+
+		// a future of the response, continuations run where the completion does
+		template <typename... Ts>
+		Future<Response> Request(Method method, Ts&&... ts);
+
+		// transfers submitted and not completed yet
+		size_t InFlightCount();
+
+		EngineStats Stats();
+
+	private:
+
+		friend struct __session_awaiter_t;
+
+		std::future<void> __submit(std::unique_ptr<Session> session, Method method, std::function<void(Response)> complete);
+		Future<Response> __request(std::unique_ptr<Session> session, Method method);
+		// queue the transfer without a std::promise
+		void __enqueue(std::unique_ptr<Session> session, Method method, std::function<void(Response)> complete, std::unique_ptr<std::promise<void>> promise);
+
+	private:
+
+		std::shared_ptr<struct __engine_t> _engine;
+	};
+
+	template <typename... Ts>
+	std::future<void> Engine::Submit(Method method, std::function<void(Response)> complete, Ts&&... ts)
+	{
+		std::unique_ptr<Session> session(new Session());
+		priv::__set_option(*session, HTTP_FWD(ts)...);
+		return __submit(HTTP_MOVE(session), method, HTTP_MOVE(complete));
+	}
+
+	template <typename... Ts>
+	Future<Response> Engine::Request(Method method, Ts&&... ts)
+	{
+		std::unique_ptr<Session> session(new Session());
+		priv::__set_option(*session, HTTP_FWD(ts)...);
+		return __request(HTTP_MOVE(session), method);
+	}
+
 	// ----------------------------------------------------------------------------------
 	//
 	//    public api
@@ -331,7 +1349,7 @@ namespace http {
 	// Get 
 	template <typename... Ts>
 	Response Get(Ts&&... ts) {
-		Session session;
+		Session session(Pool::Default());
 		priv::__set_option(session, HTTP_FWD(ts)...);
 		return session.Get();
 	}
@@ -339,18 +1357,13 @@ namespace http {
 	// Get Async
 	template <typename... Ts>
 	std::future<void> GetAsync(std::function<void(Response)> complete, Ts... ts) {
-		return std::async(std::launch::async,
-			[complete](Ts... ts) {
-			auto resp = Get(HTTP_MOVE(ts)...);
-			complete(HTTP_MOVE(resp));
-		},
-			HTTP_MOVE(ts)...);
+		return Engine::Default().Submit(Method::get, HTTP_MOVE(complete), HTTP_MOVE(ts)...);
 	}
 
 	// Post 
 	template <typename... Ts>
 	Response Post(Ts&&... ts) {
-		Session session;
+		Session session(Pool::Default());
 		priv::__set_option(session, HTTP_FWD(ts)...);
 		return session.Post();
 	}
@@ -358,33 +1371,390 @@ namespace http {
 	// Post Async
 	template <typename... Ts>
 	std::future<void> PostAsync(std::function<void(Response)> complete, Ts... ts) {
-		return std::async(std::launch::async,
-			[complete](Ts... ts) {
-			auto resp = Post(HTTP_MOVE(ts)...);
-			complete(HTTP_MOVE(resp));
-		},
-			HTTP_MOVE(ts)...);
+		return Engine::Default().Submit(Method::post, HTTP_MOVE(complete), HTTP_MOVE(ts)...);
 	}
 
 	// Head 
 	template <typename... Ts>
 	Response Head(Ts&&... ts) {
-		Session session;
+		Session session(Pool::Default());
 		priv::__set_option(session, HTTP_FWD(ts)...);
-		return session.Post();
+		return session.Head();
 	}
 
 	// Head Async
 	template <typename... Ts>
 	std::future<void> HeadAsync(std::function<void(Response)> complete, Ts... ts) {
-		return std::async(std::launch::async,
-			[complete](Ts... ts) {
-			auto resp = Head(HTTP_MOVE(ts)...);
-			complete(HTTP_MOVE(resp));
-		},
-			HTTP_MOVE(ts)...);
+		return Engine::Default().Submit(Method::head, HTTP_MOVE(complete), HTTP_MOVE(ts)...);
+	}
+
+	// ----------------------------------------------------------------------------------
+	//
+	//    Batch
+	//
+	// ----------------------------------------------------------------------------------
+
+	// many requests on one curl_multi handle driven by the calling thread,
+	// a session is only created when its request gets a slot
+	class Batch
+	{
+	public:
+
+		Batch(size_t max_in_flight = 64, size_t max_per_host = 8);
+
+		// options are copied, pass a Share as std::ref(share)
+		// a Deadline or CancelToken fails its request the same way a Session does
+		// returns the index of the request in the results
+		template <typename... Ts>
+		size_t Add(Method method, Ts&&... ts);
+
+		size_t Size();
+
+		// run every request, responses in input order
+		std::vector<Response> Run();
+
+		// run every request, each response is handed over as soon as it completes
+		void Run(std::function<void(size_t index, Response resp)> complete);
+
+	private:
+
+		struct request_t
+		{
+			Method method_;
+			std::string url_;
+			std::function<void(Session&)> options_;
+		};
+
+		size_t _max_in_flight;
+		size_t _max_per_host;
+
+		std::vector<request_t> _requests;
+	};
+
+	template <typename... Ts>
+	size_t Batch::Add(Method method, Ts&&... ts)
+	{
+		_requests.push_back(request_t{ method, priv::__find_url(ts...), std::bind(&priv::__apply_options<typename priv::__bound_option<Ts>::type...>, std::placeholders::_1, HTTP_FWD(ts)...) });
+		return _requests.size() - 1;
+	}
+
+	// Get every url with the same options, responses in input order
+	template <typename... Ts>
+	std::vector<Response> GetMany(const std::vector<std::string>& urls, Ts&&... ts) {
+		Batch batch;
+		for (const auto& url : urls)
+		{
+			batch.Add(Method::get, URL{ std::string(url) }, ts...);
+		}
+		return batch.Run();
+	}
+
+	namespace async {
+
+		// http::async::Get(options...).Then(...)
+		template <typename... Ts>
+		Future<Response> Get(Ts&&... ts) {
+			return Engine::Default().Request(Method::get, HTTP_FWD(ts)...);
+		}
+
+		template <typename... Ts>
+		Future<Response> Post(Ts&&... ts) {
+			return Engine::Default().Request(Method::post, HTTP_FWD(ts)...);
+		}
+
+		template <typename... Ts>
+		Future<Response> Head(Ts&&... ts) {
+			return Engine::Default().Request(Method::head, HTTP_FWD(ts)...);
+		}
+
+	} // namespace async
+
+	// ----------------------------------------------------------------------------------
+	//
+	//    Reactor
+	//
+	// ----------------------------------------------------------------------------------
+
+	// the reactor asks the host event loop to watch sockets and to run a timer
+	struct ReactorHooks
+	{
+		// watch the socket for Reactor::read and Reactor::write, Reactor::none stops watching it,
+		// a later call replaces the events of the earlier one
+		std::function<void(curl_socket_t socket, int events)> watch_;
+		// call OnTimeout() once timeout_ms have passed, 0 on the next turn of the loop,
+		// -1 removes the timer, a later call replaces the earlier timer
+		std::function<void(long timeout_ms)> timer_;
+		// optional, called on the thread that cancels a token of a running request,
+		// the loop should call OnTimeout() soon, without it the cancellation waits for the next call
+		std::function<void()> wakeup_;
+	};
+
+	// requests driven by the event loop of the host through curl_multi_socket_action,
+	// without threads of its own, every call must come from the loop thread
+	// and the hooks must not call back into the reactor
+	class Reactor
+	{
+	public:
+
+		enum Events
+		{
+			none = 0,
+			read = 1,
+			write = 2,
+			// errors and hangups, only passed to OnSocketReady
+			error = 4,
+		};
+
+		Reactor(ReactorHooks hooks);
+		// requests still running complete with ErrorCode::aborted,
+		// the watch hook is still told about the sockets curl closes
+		~Reactor();
+
+		Reactor(const Reactor&) = delete;
+		Reactor& operator=(const Reactor&) = delete;
+
+		// attach every transfer submitted afterwards to the share, the share must outlive the reactor
+		void SetShare(Share* share);
+
+		// the completion runs inside OnSocketReady or OnTimeout,
+		// Priority is ignored, a cancelled token stops the transfer on the next OnSocketReady or OnTimeout
+		template <typename... Ts>
+		void Submit(Method method, std::function<void(Response)> complete, Ts&&... ts);
+
+		template <typename... Ts>
+		Future<Response> Request(Method method, Ts&&... ts);
+
+		// entry points for the host loop
+		void OnSocketReady(curl_socket_t socket, int events);
+		void OnTimeout();
+
+		// transfers submitted and not completed yet
+		size_t InFlightCount();
+
+	private:
+
+		void __submit(std::unique_ptr<Session> session, Method method, std::function<void(Response)> complete);
+
+	private:
+
+		std::shared_ptr<struct __reactor_t> _reactor;
+	};
+
+	template <typename... Ts>
+	void Reactor::Submit(Method method, std::function<void(Response)> complete, Ts&&... ts)
+	{
+		std::unique_ptr<Session> session(new Session());
+		priv::__set_option(*session, HTTP_FWD(ts)...);
+		__submit(HTTP_MOVE(session), method, HTTP_MOVE(complete));
+	}
+
+	template <typename... Ts>
+	Future<Response> Reactor::Request(Method method, Ts&&... ts)
+	{
+		auto state = std::make_shared<__future_state_t<Response>>();
+		Submit(method, [state](Response resp) {
+			state->SetValue(HTTP_MOVE(resp));
+		}, HTTP_FWD(ts)...);
+		return Future<Response>(state);
+	}
+
+#if HTTP_HAS_COROUTINE
+
+	// ----------------------------------------------------------------------------------
+	//
+	//    Coroutine
+	//
+	// ----------------------------------------------------------------------------------
+
+	// lazy coroutine, starts when awaited and resumes the awaiting coroutine when done
+	template <typename T>
+	class Task
+	{
+	public:
+
+		struct promise_type
+		{
+			T value_{};
+			std::exception_ptr exception_;
+			std::coroutine_handle<> continuation_;
+
+			struct final_awaiter
+			{
+				bool await_ready() noexcept { return false; }
+
+				// symmetric transfer, no stack growth on long await chains
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+					auto continuation = handle.promise().continuation_;
+					return continuation ? continuation : std::noop_coroutine();
+				}
+
+				void await_resume() noexcept {}
+			};
+
+			Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+			std::suspend_always initial_suspend() noexcept { return {}; }
+			final_awaiter final_suspend() noexcept { return {}; }
+			void return_value(T value) { value_ = HTTP_MOVE(value); }
+			void unhandled_exception() { exception_ = std::current_exception(); }
+		};
+
+		Task(Task&& other) noexcept : _handle(other._handle) { other._handle = nullptr; }
+		Task& operator=(Task&& other) noexcept {
+			if (this != &other)
+			{
+				if (_handle) _handle.destroy();
+				_handle = other._handle;
+				other._handle = nullptr;
+			}
+			return *this;
+		}
+		Task(const Task&) = delete;
+		Task& operator=(const Task&) = delete;
+
+		~Task() {
+			if (_handle) _handle.destroy();
+		}
+
+		// awaitable
+		bool await_ready() noexcept { return false; }
+
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+			_handle.promise().continuation_ = awaiting;
+			return _handle;
+		}
+
+		T await_resume() {
+			if (_handle.promise().exception_)
+			{
+				std::rethrow_exception(_handle.promise().exception_);
+			}
+			return HTTP_MOVE(_handle.promise().value_);
+		}
+
+		// block the calling thread until the task is done, for code outside coroutines
+		T Get();
+
+	private:
+
+		explicit Task(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+
+		std::coroutine_handle<promise_type> _handle;
+	};
+
+	namespace co {
+
+		// fire and forget coroutine, the frame frees itself when done
+		struct Detached
+		{
+			struct promise_type
+			{
+				Detached get_return_object() { return {}; }
+				std::suspend_never initial_suspend() noexcept { return {}; }
+				std::suspend_never final_suspend() noexcept { return {}; }
+				void return_void() {}
+				void unhandled_exception() { std::terminate(); }
+			};
+		};
+
+		// run the task without waiting for it, an exception it throws is dropped
+		template <typename T>
+		Detached Spawn(Task<T> task) {
+			try
+			{
+				co_await task;
+			}
+			catch (...) {}
+		}
+
+	} // namespace co
+
+	template <typename T>
+	T Task<T>::Get()
+	{
+		std::mutex mutex;
+		std::condition_variable cond;
+		bool done = false;
+		T value{};
+		std::exception_ptr exception;
+
+		[](Task& task, T& value, std::exception_ptr& exception, std::mutex& mutex, std::condition_variable& cond, bool& done) -> co::Detached {
+			try
+			{
+				value = co_await task;
+			}
+			catch (...)
+			{
+				exception = std::current_exception();
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			done = true;
+			cond.notify_one();
+		}(*this, value, exception, mutex, cond, done);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		cond.wait(lock, [&done] { return done; });
+
+		if (exception)
+		{
+			std::rethrow_exception(exception);
+		}
+		return value;
 	}
 
+	// suspends the coroutine until the engine completes the session, it resumes where the completion runs
+	struct __session_awaiter_t
+	{
+		Engine& engine_;
+		Method method_;
+		std::unique_ptr<Session> session_;
+		Response response_;
+
+		bool await_ready() noexcept { return false; }
+
+		void await_suspend(std::coroutine_handle<> handle) {
+			// the coroutine may resume before __submit returns, don't touch this afterwards
+			engine_.__enqueue(HTTP_MOVE(session_), method_, [this, handle](Response resp) {
+				response_ = HTTP_MOVE(resp);
+				handle.resume();
+			}, nullptr);
+		}
+
+		Response await_resume() { return HTTP_MOVE(response_); }
+	};
+
+	namespace co {
+
+		// co_await http::co::Submit(engine, method, options...)
+		template <typename... Ts>
+		Task<Response> Submit(Engine& engine, Method method, Ts... ts) {
+			std::unique_ptr<Session> session(new Session());
+			priv::__set_option(*session, ts...);
+			// a named awaiter lives in the frame, some compilers mishandle temporaries across suspension
+			__session_awaiter_t awaiter{ engine, method, HTTP_MOVE(session), Response() };
+			co_return co_await awaiter;
+		}
+
+		// co_await http::co::Get(options...)
+		template <typename... Ts>
+		Task<Response> Get(Ts... ts) {
+			return Submit(Engine::Default(), Method::get, HTTP_MOVE(ts)...);
+		}
+
+		template <typename... Ts>
+		Task<Response> Post(Ts... ts) {
+			return Submit(Engine::Default(), Method::post, HTTP_MOVE(ts)...);
+		}
+
+		template <typename... Ts>
+		Task<Response> Head(Ts... ts) {
+			return Submit(Engine::Default(), Method::head, HTTP_MOVE(ts)...);
+		}
+
+	} // namespace co
+
+#endif // HTTP_HAS_COROUTINE
+
 	
 } // namespace http
 
@@ -8,6 +8,31 @@
 
 #include <http/http.h>
 
+#include <deque>
+#include <list>
+#include <climits>
+#include <cstring>
+
+#ifdef _WIN32
+// winsock2.h is included by curl.h
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <cerrno>
+#endif
+
+// largest Content-Length a body buffer is reserved for up front, bigger bodies grow as they arrive
+#ifndef HTTP_MAX_PRESIZE
+#define HTTP_MAX_PRESIZE (1024 * 1024 * 1024)
+#endif
+
 namespace http {
 
 	namespace priv {
@@ -16,58 +41,459 @@ namespace http {
 
 			std::string __url_encode(const std::string& value_to_escape);
 
+			std::string __url_origin(const std::string& url);
+
+			// a request that never got a response
+			Response __error_response(ErrorCode code, const char* reason);
+
+			// message of a request stopped by its cancel token or deadline
+			const char* __stop_reason(ErrorCode code);
+
+			// the first size bytes of data start with prefix, ascii case ignored
+			bool __starts_with_icase(const char* data, size_t size, const char* prefix);
+
+		}
+
+	}
+
+	struct __buffer_stats_t
+	{
+		std::atomic<uint64_t> presized_{ 0 };
+		std::atomic<uint64_t> reallocations_{ 0 };
+		std::atomic<uint64_t> preallocated_files_{ 0 };
+	};
+
+	static __buffer_stats_t __buffer_stats;
+
+	// size classes of the buffer pool, 1KB << class
+	static const size_t __buffer_class_min = 1024;
+	static const int __buffer_classes = 13;
+
+	struct __buffer_pool_t
+	{
+		std::atomic<size_t> max_retained_{ 0 };
+		std::atomic<size_t> thread_cache_{ 4 };
+		std::atomic<size_t> retained_{ 0 };
+
+		std::atomic<uint64_t> hits_{ 0 };
+		std::atomic<uint64_t> misses_{ 0 };
+		std::atomic<uint64_t> recycled_{ 0 };
+		std::atomic<uint64_t> dropped_{ 0 };
+
+		std::mutex mutex_;
+		std::vector<std::string> shared_[__buffer_classes];
+	};
+
+	static __buffer_pool_t __buffer_pool;
+
+	// the buffers a thread reuses without the lock, freed when the thread exits
+	struct __buffer_cache_t
+	{
+		std::vector<std::string> buffers_[__buffer_classes];
+
+		void Clear() {
+			for (auto& buffers : buffers_)
+			{
+				for (auto& buffer : buffers)
+				{
+					__buffer_pool.retained_.fetch_sub(buffer.capacity(), std::memory_order_relaxed);
+				}
+				buffers.clear();
+			}
+		};
+
+		~__buffer_cache_t() { Clear(); }
+	};
+
+	static thread_local __buffer_cache_t __buffer_cache;
+
+	// a buffer of at least size bytes for an empty body, false when the pool is off
+	static bool __buffer_acquire(std::string& data, size_t size)
+	{
+		if (__buffer_pool.max_retained_.load(std::memory_order_relaxed) == 0)
+		{
+			return false;
+		}
+
+		int index = 0;
+		while (index < __buffer_classes && (__buffer_class_min << index) < size)
+		{
+			++index;
+		}
+		if (index == __buffer_classes)
+		{
+			return false;
+		}
+
+		auto& cached = __buffer_cache.buffers_[index];
+		if (cached.empty())
+		{
+			std::lock_guard<std::mutex> lock(__buffer_pool.mutex_);
+			auto& shared = __buffer_pool.shared_[index];
+			if (!shared.empty())
+			{
+				cached.push_back(HTTP_MOVE(shared.back()));
+				shared.pop_back();
+			}
+		}
+
+		if (cached.empty())
+		{
+			__buffer_pool.misses_.fetch_add(1, std::memory_order_relaxed);
+			// a whole class, the buffer fits it again when it comes back
+			data.reserve(__buffer_class_min << index);
+			return true;
+		}
+
+		data.swap(cached.back());
+		cached.pop_back();
+		__buffer_pool.retained_.fetch_sub(data.capacity(), std::memory_order_relaxed);
+		__buffer_pool.hits_.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// kept in the largest class it covers, freed by the caller when it isn't kept
+	static void __buffer_release(std::string&& data)
+	{
+		auto max_retained = __buffer_pool.max_retained_.load(std::memory_order_relaxed);
+		auto capacity = data.capacity();
+		if (max_retained == 0 || capacity < __buffer_class_min)
+		{
+			return;
+		}
+
+		int index = 0;
+		while (index + 1 < __buffer_classes && (__buffer_class_min << (index + 1)) <= capacity)
+		{
+			++index;
+		}
+
+		// a buffer far past the largest class would be kept for much less than it holds
+		if (capacity >= (__buffer_class_min << __buffer_classes))
+		{
+			__buffer_pool.dropped_.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		if (__buffer_pool.retained_.fetch_add(capacity, std::memory_order_relaxed) + capacity > max_retained)
+		{
+			__buffer_pool.retained_.fetch_sub(capacity, std::memory_order_relaxed);
+			__buffer_pool.dropped_.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		data.clear();
+		__buffer_pool.recycled_.fetch_add(1, std::memory_order_relaxed);
+
+		auto& cached = __buffer_cache.buffers_[index];
+		if (cached.size() < __buffer_pool.thread_cache_.load(std::memory_order_relaxed))
+		{
+			cached.push_back(HTTP_MOVE(data));
+			return;
 		}
 
+		std::lock_guard<std::mutex> lock(__buffer_pool.mutex_);
+		__buffer_pool.shared_[index].push_back(HTTP_MOVE(data));
 	}
 
-	enum __write_data_type
+	// OnData as a custom sink
+	class __on_data_writer_t : public BodyWriter
 	{
-		stream,
-		string,
+	public:
+		__on_data_writer_t(const std::function<bool(const char*, size_t)>& on_data) : on_data_(on_data) {}
+
+		bool Write(const char* data, size_t size) override { return on_data_(data, size); }
+
+	private:
+		std::function<bool(const char*, size_t)> on_data_;
 	};
 
 	struct __write_data_t
 	{
-		__write_data_type type_;
+		BodySink sink_;
 		std::string string_data_;
 		std::ofstream stream_data_;
+		// the halves of a tee sink
+		std::unique_ptr<__write_data_t> first_;
+		std::unique_ptr<__write_data_t> second_;
+		// body bytes of the current response, wherever they went
+		size_t size_ = 0;
+		// a custom sink asked to stop
+		bool stopped_ = false;
+		// a buffer sink ran out of room
+		bool truncated_ = false;
+		// MaxBodyBytes or MaxHeaderBytes, 0 for no limit
+		size_t max_size_ = 0;
+		bool too_large_ = false;
+		// body data only, the Content-Length of the last header block is the final response's
+		// when the first chunk arrives, curl drops the bodies of the redirects it follows
+		const struct __write_data_t *header_ = nullptr;
+
+		// header data only, the Content-Length of the current header block
+		long long content_length_ = -1;
+
+		// a file sink opens its file here, like DownloadFilePath always did
+		void SetSink(const BodySink& sink) {
+			TryCloseStream();
+			first_.reset();
+			second_.reset();
+			sink_ = sink;
+
+			switch (sink_._kind)
+			{
+			case BodySink::file:
+				stream_data_.open(sink_._path, std::ios::trunc | std::ios::binary);
+				break;
+			case BodySink::tee:
+				first_.reset(new __write_data_t);
+				first_->SetSink(*sink_._first);
+				second_.reset(new __write_data_t);
+				second_->SetSink(*sink_._second);
+				break;
+			default:
+				break;
+			}
+		};
+
+		// false stops the transfer, only a custom sink gets a virtual call
+		bool SetData(const char* ptr, size_t size) {
+			size_t offset = size_;
+			size_ += size;
+
+			// no need to wait for the rest of the body to know it is too large
+			if (offset == 0 && header_ && max_size_ && header_->content_length_ > 0
+				&& (unsigned long long)header_->content_length_ > max_size_)
+			{
+				too_large_ = true;
+				return false;
+			}
+			// room for the whole body before the rest of it arrives
+			if (offset == 0 && header_ && header_->content_length_ > 0)
+			{
+				Presize(header_->content_length_);
+			}
+			if (max_size_ && size_ > max_size_)
+			{
+				too_large_ = true;
+				return false;
+			}
+
+			switch (sink_._kind)
+			{
+			case BodySink::memory:
+			{
+				// a chunked body starts in a pooled buffer too
+				if (offset == 0 && string_data_.capacity() < size)
+				{
+					__buffer_acquire(string_data_, size);
+				}
+				auto capacity = string_data_.capacity();
+				string_data_.append(ptr, size);
+				if (string_data_.capacity() != capacity)
+				{
+					__buffer_stats.reallocations_.fetch_add(1, std::memory_order_relaxed);
+				}
+				break;
+			}
+			case BodySink::file:
+				stream_data_.write(ptr, size);
+				break;
+			case BodySink::buffer:
+				if (offset < sink_._capacity)
+				{
+					memcpy(sink_._data + offset, ptr, (std::min)(size, sink_._capacity - offset));
+				}
+				if (size_ > sink_._capacity)
+				{
+					truncated_ = true;
+					stopped_ = sink_._overflow == BodySink::stop;
+					return !stopped_;
+				}
+				break;
+			case BodySink::discard:
+				break;
+			case BodySink::tee:
+				stopped_ = !first_->SetData(ptr, size) || !second_->SetData(ptr, size);
+				return !stopped_;
+			case BodySink::custom:
+				try
+				{
+					stopped_ = !sink_._writer->Write(ptr, size);
+				}
+				catch (...)
+				{
+					// must not unwind through curl
+					stopped_ = true;
+				}
+				return !stopped_;
+			}
+			return true;
+		};
+
+		// one header line, false stops the transfer
+		bool SetHeader(char* ptr, size_t size) {
+			if (max_size_ && string_data_.size() + size > max_size_)
+			{
+				too_large_ = true;
+				return false;
+			}
+			string_data_.append(ptr, size);
 
-		__write_data_t() { type_ = __write_data_type::string; };
-		__write_data_t(__write_data_type type) { type_ = type; };
+			if (size >= 5 && strncmp(ptr, "HTTP/", 5) == 0)
+			{
+				// a new response, after a redirect or a 100 Continue
+				content_length_ = -1;
+			}
+			else if (priv::util::__starts_with_icase(ptr, size, "content-length:"))
+			{
+				size_t i = 15;
+				while (i < size && (ptr[i] == ' ' || ptr[i] == '\t'))
+				{
+					++i;
+				}
+				// every digit counts, a length too big for long long stays too big
+				long long length = -1;
+				for (; i < size && ptr[i] >= '0' && ptr[i] <= '9'; ++i)
+				{
+					int digit = ptr[i] - '0';
+					if (length < 0)
+					{
+						length = digit;
+					}
+					else if (length > (LLONG_MAX - digit) / 10)
+					{
+						length = LLONG_MAX;
+					}
+					else
+					{
+						length = length * 10 + digit;
+					}
+				}
+				content_length_ = length;
+			}
+			return true;
+		};
 
-		void SetData(void* ptr, size_t size) {
+		// room for the whole body before it arrives, chunked bodies keep growing geometrically
+		void Presize(long long length) {
+			if (length > HTTP_MAX_PRESIZE)
+			{
+				return;
+			}
 
-			switch (type_)
+			switch (sink_._kind)
+			{
+			case BodySink::memory:
+				if (string_data_.capacity() < (size_t)length)
+				{
+					try
+					{
+						if (!string_data_.empty() || !__buffer_acquire(string_data_, (size_t)length))
+						{
+							string_data_.reserve((size_t)length);
+						}
+						__buffer_stats.presized_.fetch_add(1, std::memory_order_relaxed);
+					}
+					catch (const std::bad_alloc&)
+					{
+						// grows as the body arrives instead
+					}
+				}
+				break;
+#ifdef __linux__
+			case BodySink::file:
 			{
-			case http::stream:
-				stream_data_.write(static_cast<char*>(ptr), size);
+				// the blocks are reserved, the file still grows with the writes and a failed download isn't padded
+				int fd = open(sink_._path.c_str(), O_WRONLY | O_CLOEXEC);
+				if (fd >= 0)
+				{
+					if (fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)length) == 0)
+					{
+						__buffer_stats.preallocated_files_.fetch_add(1, std::memory_order_relaxed);
+					}
+					close(fd);
+				}
+				break;
+			}
+#endif
+			case BodySink::tee:
+				first_->Presize(length);
+				second_->Presize(length);
 				break;
-			case http::string:
-				string_data_.append(static_cast<char*>(ptr), size);
+			case BodySink::custom:
+				try
+				{
+					sink_._writer->Reserve((size_t)length);
+				}
+				catch (...)
+				{
+					// only a hint
+				}
 				break;
 			default:
 				break;
 			}
 		};
 
-		std::string TryGetStringData() {
-			if (type_ == string)
+		// a reused session must not append to the previous body
+		void Rewind() {
+			if (sink_._kind == BodySink::memory)
 			{
-				return string_data_;
+				string_data_.clear();
 			}
+			else if (sink_._kind == BodySink::tee)
+			{
+				first_->Rewind();
+				second_->Rewind();
+			}
+			size_ = 0;
+			stopped_ = false;
+			truncated_ = false;
+			too_large_ = false;
+		};
 
-			return "";
+		// some buffer sink ran out of room
+		bool Truncated() const {
+			return truncated_ || (first_ && (first_->Truncated() || second_->Truncated()));
 		};
 
-		void OpenStream(std::string& filepath) {
-			stream_data_.open(filepath, std::ios::trunc | std::ios::binary);
+		// the body moves out, the next request starts with an empty string
+		std::string TryTakeStringData() {
+			if (sink_._kind == BodySink::memory)
+			{
+				return HTTP_MOVE(string_data_);
+			}
+			else if (sink_._kind == BodySink::tee)
+			{
+				auto data = first_->TryTakeStringData();
+				return data.empty() ? second_->TryTakeStringData() : data;
+			}
+
+			return "";
 		};
 
 		void TryCloseStream() {
-			if (type_ == stream && stream_data_.is_open())
+			if (stream_data_.is_open())
 			{
 				stream_data_.close();
 			}
+			if (first_)
+			{
+				first_->TryCloseStream();
+				second_->TryCloseStream();
+			}
+		};
+
+		// drop the data, the header string keeps its capacity for the next request
+		void Clear() {
+			SetSink(BodySink());
+			string_data_.clear();
+			size_ = 0;
+			stopped_ = false;
+			truncated_ = false;
+			max_size_ = 0;
+			too_large_ = false;
+			content_length_ = -1;
 		};
 	};
 
@@ -104,6 +530,61 @@ namespace http {
 		}
 	}
 
+	// ----------------------------------------------------------------------------------
+	//
+	//    CancelToken
+	//
+	// ----------------------------------------------------------------------------------
+
+	struct __cancel_state_t
+	{
+		std::mutex mutex_;
+		std::atomic<bool> cancelled_{ false };
+
+		// run once on Cancel() under the lock, so a removed callback is never running
+		uint64_t next_id_ = 0;
+		std::unordered_map<uint64_t, std::function<void()>> callbacks_;
+
+		// 0 if cancelled already
+		uint64_t Subscribe(std::function<void()> callback) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (cancelled_.load())
+			{
+				return 0;
+			}
+			callbacks_.emplace(++next_id_, HTTP_MOVE(callback));
+			return next_id_;
+		};
+
+		void Unsubscribe(uint64_t id) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			callbacks_.erase(id);
+		};
+	};
+
+	CancelToken::CancelToken()
+		: _state(std::make_shared<__cancel_state_t>()) {}
+
+	void CancelToken::Cancel()
+	{
+		std::lock_guard<std::mutex> lock(_state->mutex_);
+		if (_state->cancelled_.exchange(true))
+		{
+			return;
+		}
+
+		for (auto& callback : _state->callbacks_)
+		{
+			callback.second();
+		}
+		_state->callbacks_.clear();
+	}
+
+	bool CancelToken::Cancelled() const
+	{
+		return _state->cancelled_.load();
+	}
+
 	// ----------------------------------------------------------------------------------
 	//
 	//    Session
@@ -112,6 +593,8 @@ namespace http {
 
 	Session::Session()
 	{
+		_priority = Priority::normal;
+		_pool = nullptr;
 		_curl_handle_ptr = std::unique_ptr<CURLHandle, std::function<void(CURLHandle *)>>(Session::__curl_handle_init(), &Session::__curl_handle_free);
 
 		// don't use make_unique, because it's completed in c++14
@@ -122,53 +605,73 @@ namespace http {
 		// use make_shared can't add custom deleter
 		// use shared_ptr to pass custom deleter
 		_response_data_ptr = std::shared_ptr<struct __write_data_t>(new __write_data_t, __resp_data_deleter);
-		auto curl = _curl_handle_ptr->curl_;
-
-		if (curl)
-		{
-			//curl defaults 
-			auto version_info = curl_version_info(CURLVERSION_NOW);
-			auto version = std::string{ "curl/" } + std::string{ version_info->version };
-			curl_easy_setopt(curl, CURLOPT_USERAGENT, version.data());
-			curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-			curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
-			curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 50L);
+		_header_data_ptr = std::shared_ptr<struct __write_data_t>(new __write_data_t, __resp_data_deleter);
+		_response_data_ptr->header_ = _header_data_ptr.get();
+	}
 
-		}
+	Session::Session(Pool& pool)
+	{
+		_priority = Priority::normal;
+		// the handle is borrowed by __request
+		_pool = &pool;
 
+		_response_data_ptr = std::shared_ptr<struct __write_data_t>(new __write_data_t, __resp_data_deleter);
+		_header_data_ptr = std::shared_ptr<struct __write_data_t>(new __write_data_t, __resp_data_deleter);
+		_response_data_ptr->header_ = _header_data_ptr.get();
 	}
 
 	// public
 	Response Session::Get()
 	{
-		auto curl = _curl_handle_ptr->curl_;
-		if (curl) {
-			curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
-			curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "GET");
-		}
-
-		return __request(curl);
+		__set_method(Method::get);
+		return __request();
 	}
 
 	Response Session::Post()
 	{
-		auto curl = _curl_handle_ptr->curl_;
-		if (curl) {
-			curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
-			curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "POST");
-		}
-
-		return __request(curl);
+		__set_method(Method::post);
+		return __request();
 	}
 
 	Response Session::Head()
 	{
-		auto curl = _curl_handle_ptr->curl_;
-		if (curl) {
-			curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, NULL);
-			curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+		__set_method(Method::head);
+		return __request();
+	}
+
+	// lifecycle
+	void Session::Reset()
+	{
+		_url = URL{};
+		_parameters = Parameters{};
+		_progress = Progress{};
+		_priority = Priority::normal;
+		_http_version = HttpVersion::any;
+		_cancel.reset();
+		_deadline = Deadline{};
+#ifdef HTTP_HAS_PMR
+		_arena = nullptr;
+#endif
+
+		_method = Method::get;
+		_headers = Headers{};
+		_multipart.reset();
+		_payload.reset();
+
+		_response_data_ptr->Clear();
+		_header_data_ptr->Clear();
+
+		// a session on a pool holds no handle here
+		if (_curl_handle_ptr)
+		{
+			// live connections, dns and tls session caches survive curl_easy_reset
+			curl_easy_reset(_curl_handle_ptr->curl_);
+
+			curl_slist_free_all(_curl_handle_ptr->chunk_);
+			_curl_handle_ptr->chunk_ = nullptr;
+			curl_mime_free(_curl_handle_ptr->mime_);
+			_curl_handle_ptr->mime_ = nullptr;
 		}
-		return __request(curl);
 	}
 
 	// options
@@ -179,101 +682,286 @@ namespace http {
 	void Session::SetOption(Progress& progress) { __set_progress(progress); }
 	void Session::SetOption(Multipart& multipart) { __set_multipart(multipart); }
 	void Session::SetOption(Payload& payload) { __set_payload(payload); }
+	void Session::SetOption(Share& share) { __set_share(share); }
+	void Session::SetOption(Priority& priority) { __set_priority(priority); }
+	void Session::SetOption(HttpVersion& version) { __set_http_version(version); }
+	void Session::SetOption(CancelToken& token) { __set_cancel_token(token); }
+	void Session::SetOption(Deadline& deadline) { __set_deadline(deadline); }
+	void Session::SetOption(OnData& on_data) { __set_on_data(on_data); }
+	void Session::SetOption(BodySink& sink) { __set_body_sink(sink); }
+	void Session::SetOption(MaxBodyBytes& max_body_bytes) { __set_max_body_bytes(max_body_bytes); }
+	void Session::SetOption(MaxHeaderBytes& max_header_bytes) { __set_max_header_bytes(max_header_bytes); }
+#ifdef HTTP_HAS_PMR
+	void Session::SetOption(Arena& arena) { __set_arena(arena); }
+#endif
 
 	// private
 	void Session::__set_url(URL& url) { _url = url; }
 	void Session::__set_parameters(Parameters& parameters) { _parameters = parameters; }
+	void Session::__set_priority(Priority& priority) { _priority = priority; }
+	void Session::__set_cancel_token(CancelToken& token) { _cancel = token._state; }
+	void Session::__set_deadline(Deadline& deadline) { _deadline = deadline; }
 
-	void Session::__set_headers(Headers& headers) 
-	{ 
-		auto curl = _curl_handle_ptr->curl_;
+	void Session::__set_headers(Headers& headers) { _headers = headers; }
 
-		if (curl)
-		{
-			auto chunk = headers.Chunk();
-			curl_easy_setopt(curl, CURLOPT_HTTPHEADER, chunk);
-			curl_slist_free_all(_curl_handle_ptr->chunk_);
-			_curl_handle_ptr->chunk_ = chunk;
-		}
+	void Session::__set_download_filepath(DownloadFilePath& filepath)
+	{
+		_response_data_ptr->SetSink(BodySink::File(filepath.value_));
 	}
 
-	void Session::__set_download_filepath(DownloadFilePath& filepath)
+	void Session::__set_on_data(OnData& on_data)
 	{
-		_response_data_ptr->type_ = stream;
-		_response_data_ptr->OpenStream(filepath.value_);
+		_response_data_ptr->SetSink(BodySink::Custom(std::make_shared<__on_data_writer_t>(on_data.value_)));
 	}
 
-	void Session::__set_progress(Progress& progress)
+	void Session::__set_body_sink(BodySink& sink)
 	{
-		auto curl = _curl_handle_ptr->curl_;
+		_response_data_ptr->SetSink(sink);
+	}
 
-		if (curl)
-		{
-			_progress = progress;
-			curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, &__xfer_info);
-			curl_easy_setopt(curl, CURLOPT_XFERINFODATA, this);
-			curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
-		}
+	void Session::__set_max_body_bytes(MaxBodyBytes& max_body_bytes)
+	{
+		_response_data_ptr->max_size_ = max_body_bytes.value_;
 	}
 
-	void Session::__set_multipart(Multipart& multipart)
+	void Session::__set_max_header_bytes(MaxHeaderBytes& max_header_bytes)
 	{
-		auto curl = _curl_handle_ptr->curl_;
+		_header_data_ptr->max_size_ = max_header_bytes.value_;
+	}
+
+#ifdef HTTP_HAS_PMR
+	void Session::__set_arena(Arena& arena)
+	{
+		_arena = arena.value_;
+	}
+#endif
 
-		if (curl)
+	void Session::__set_progress(Progress& progress) { _progress = progress; }
+	void Session::__set_multipart(Multipart& multipart) { _multipart.reset(new Multipart(multipart)); }
+	void Session::__set_payload(Payload& payload) { _payload.reset(new std::string(payload.value_)); }
+	void Session::__set_http_version(HttpVersion& version) { _http_version = version; }
+	void Session::__set_share(Share& share) { _share = &share; }
+	void Session::__set_method(Method method) { _method = method; }
+
+	Response Session::__request()
+	{
+		ErrorCode code;
+		if (__stopped(code))
 		{
-			auto mime = multipart.Add2Curl(curl);
-			curl_mime_free(_curl_handle_ptr->mime_);
-			_curl_handle_ptr->mime_ = mime;
+			return priv::util::__error_response(code, priv::util::__stop_reason(code));
 		}
+
+		if (!_pool)
+		{
+			auto curl = _curl_handle_ptr->curl_;
+			__prepare(curl);
+			__set_timeout(curl);
+			return __response(curl, curl_easy_perform(curl));
+		}
+
+		// the slot of this host first, a session waiting for a busy host holds no handle
+		auto host = priv::util::__url_origin(_url.value_);
+		_pool->__acquire_host(host);
+
+		// the handle goes back to the pool instead of being cleaned up
+		auto pool = _pool;
+		_curl_handle_ptr = std::unique_ptr<CURLHandle, std::function<void(CURLHandle *)>>(pool->__acquire(), [pool](CURLHandle *handle) {
+			pool->__release(handle);
+		});
+
+		auto curl = _curl_handle_ptr->curl_;
+		__prepare(curl);
+		__set_timeout(curl);
+		auto res = curl_easy_perform(curl);
+		_pool->__release_host(host);
+
+		auto resp = __response(curl, res);
+		_curl_handle_ptr.reset();
+		return resp;
 	}
 
-	void Session::__set_payload(Payload& payload)
+	void Session::__set_timeout(CURL *curl)
 	{
-		auto curl = _curl_handle_ptr->curl_;
-		if (curl)
+		// the async engine keeps deadlines in the timing wheel of its loop
+		if (_deadline.value_ != std::chrono::steady_clock::time_point())
 		{
-			curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, payload.value_.length());
-			curl_easy_setopt(curl, CURLOPT_COPYPOSTFIELDS, payload.value_.data());
+			auto left = std::chrono::duration_cast<std::chrono::milliseconds>(_deadline.value_ - std::chrono::steady_clock::now()).count();
+			curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)(std::max)(left, (decltype(left))1));
 		}
 	}
 
-	Response Session::__request(CURL *curl)
+	void Session::__prepare(CURL *curl)
 	{
-		CURLcode res = CURLE_OK;
-
-		// set url
-		auto url = _url.value_ + "?" + _parameters.format_value_;
+		// set url, curl keeps a copy
+#ifdef HTTP_HAS_PMR
+		std::pmr::string url(_arena ? _arena : std::pmr::get_default_resource());
+#else
+		std::string url;
+#endif
+		url.reserve(_url.value_.size() + 1 + _parameters.format_value_.size());
+		url.append(_url.value_).append("?").append(_parameters.format_value_);
 		curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
 
-		__write_data_t head_string;
+		_response_data_ptr->Rewind();
+		_header_data_ptr->Rewind();
 
 		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &__write_function);
 		curl_easy_setopt(curl, CURLOPT_WRITEDATA, _response_data_ptr.get());
-		curl_easy_setopt(curl, CURLOPT_HEADERDATA, &head_string);
-
-		res = curl_easy_perform(curl);
-
-		long resp_code = -1;
-		std::string error;
+		curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, &__header_function);
+		curl_easy_setopt(curl, CURLOPT_HEADERDATA, _header_data_ptr.get());
 
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &resp_code);
+		__set_defaults(curl);
 
-		if (res != CURLE_OK)
+		switch (_method)
 		{
-			error = curl_easy_strerror(res);
-			std::cout << "[curl error] : " << std::endl << "[code] " << res << std::endl << "[message] " << error << std::endl;
-		}
-
-		return Response(
-			HTTP_MOVE(resp_code), 
-			HTTP_MOVE(_response_data_ptr->TryGetStringData()),
-			HTTP_MOVE(Headers(head_string.TryGetStringData())),
-			HTTP_MOVE(error)
+		case Method::get:
+			curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
+			curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "GET");
+			break;
+		case Method::post:
+			curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
+			curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "POST");
+			break;
+		case Method::head:
+			curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, NULL);
+			curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+			break;
+		default:
+			break;
+		}
+
+		long version = CURL_HTTP_VERSION_NONE;
+		switch (_http_version)
+		{
+		case HttpVersion::any:
+			break;
+		case HttpVersion::http1_1:
+			version = CURL_HTTP_VERSION_1_1;
+			break;
+		case HttpVersion::http2:
+			version = CURL_HTTP_VERSION_2TLS;
+			break;
+		case HttpVersion::http2_prior_knowledge:
+			version = CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE;
+			break;
+		}
+		curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, version);
+
+		// the handle owns the lists built for its request
+		auto chunk = _headers.Chunk();
+		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, chunk);
+		curl_slist_free_all(_curl_handle_ptr->chunk_);
+		_curl_handle_ptr->chunk_ = chunk;
+
+		if (_multipart)
+		{
+			auto mime = _multipart->Add2Curl(curl);
+			curl_mime_free(_curl_handle_ptr->mime_);
+			_curl_handle_ptr->mime_ = mime;
+		}
+
+		// the session keeps the payload alive for the transfer, curl doesn't copy it
+		if (_payload)
+		{
+			curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)_payload->size());
+			curl_easy_setopt(curl, CURLOPT_POSTFIELDS, _payload->data());
+		}
+
+		if (_share)
+		{
+			curl_easy_setopt(curl, CURLOPT_SHARE, _share->Handle());
+		}
+
+		// the progress callback reports progress and aborts the transfer once the token is cancelled
+		if (_progress.value_ || _cancel)
+		{
+			curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, &__xfer_info);
+			curl_easy_setopt(curl, CURLOPT_XFERINFODATA, this);
+			curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+		}
+	}
+
+	bool Session::__stopped(ErrorCode& code)
+	{
+		if (_cancel && _cancel->cancelled_.load())
+		{
+			code = ErrorCode::cancelled;
+			return true;
+		}
+
+		if (_deadline.value_ != std::chrono::steady_clock::time_point() && std::chrono::steady_clock::now() >= _deadline.value_)
+		{
+			code = ErrorCode::deadline;
+			return true;
+		}
+		return false;
+	}
+
+	Response Session::__response(CURL *curl, CURLcode res)
+	{
+		long resp_code = -1;
+		std::string error;
+
+		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &resp_code);
+
+		if (res != CURLE_OK)
+		{
+			error = curl_easy_strerror(res);
+			std::cout << "[curl error] : " << std::endl << "[code] " << res << std::endl << "[message] " << error << std::endl;
+		}
+
+		// the body is moved all the way to the caller, the headers are parsed in place
+		Response resp(
+			(int)resp_code,
+			_response_data_ptr->TryTakeStringData(),
+#ifdef HTTP_HAS_PMR
+			Headers(_header_data_ptr->string_data_, _arena ? _arena : std::pmr::get_default_resource()),
+#else
+			Headers(_header_data_ptr->string_data_),
+#endif
+			HTTP_MOVE(error)
 		);
+		resp.body_size_ = _response_data_ptr->size_;
+		resp.truncated_ = _response_data_ptr->Truncated();
+		if (res == CURLE_OK)
+		{
+			resp.error_code_ = ErrorCode::none;
+		}
+		else if (res == CURLE_ABORTED_BY_CALLBACK && _cancel && _cancel->cancelled_.load())
+		{
+			resp.error_code_ = ErrorCode::cancelled;
+		}
+		else if (res == CURLE_OPERATION_TIMEDOUT && _deadline.value_ != std::chrono::steady_clock::time_point())
+		{
+			resp.error_code_ = ErrorCode::deadline;
+		}
+		else if (res == CURLE_WRITE_ERROR && (_response_data_ptr->too_large_ || _header_data_ptr->too_large_))
+		{
+			resp.error_code_ = ErrorCode::too_large;
+		}
+		else if (res == CURLE_WRITE_ERROR && _response_data_ptr->stopped_)
+		{
+			resp.error_code_ = ErrorCode::stopped;
+		}
+		else
+		{
+			resp.error_code_ = ErrorCode::curl;
+		}
+		return resp;
 
 	}
 
+	// curl defaults
+	void Session::__set_defaults(CURL *curl)
+	{
+		//curl defaults 
+		static const std::string version = std::string{ "curl/" } + std::string{ curl_version_info(CURLVERSION_NOW)->version };
+		curl_easy_setopt(curl, CURLOPT_USERAGENT, version.data());
+		curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+		curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
+		curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 50L);
+	}
+
 	// curl init
 	CURLHandle* Session::__curl_handle_init()
 	{
@@ -304,7 +992,22 @@ namespace http {
 	size_t Session::__write_function(void* ptr, size_t size, size_t nmemb, __write_data_t *data)
 	{
 		size_t append_size = size * nmemb;
-		data->SetData(ptr, append_size);
+		if (!data->SetData(static_cast<char*>(ptr), append_size))
+		{
+			// curl fails the transfer with CURLE_WRITE_ERROR
+			return 0;
+		}
+		return append_size;
+	}
+
+	size_t Session::__header_function(char* ptr, size_t size, size_t nmemb, __write_data_t *data)
+	{
+		size_t append_size = size * nmemb;
+		if (!data->SetHeader(ptr, append_size))
+		{
+			// curl fails the transfer with CURLE_WRITE_ERROR
+			return 0;
+		}
 		return append_size;
 	}
 
@@ -312,6 +1015,12 @@ namespace http {
 	int Session::__xfer_info(void *data, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
 	{
 		auto session = (Session *)data;
+		if (session->_cancel && session->_cancel->cancelled_.load())
+		{
+			// curl fails the transfer with CURLE_ABORTED_BY_CALLBACK
+			return 1;
+		}
+
 		if (session->_progress.value_)
 		{
 			double progress = 0.0;
@@ -333,112 +1042,2986 @@ namespace http {
 
 	// ----------------------------------------------------------------------------------
 	//
-	//    private util
+	//    Share
 	//
 	// ----------------------------------------------------------------------------------
 
-	std::string priv::util::__url_encode(const std::string& value_to_escape)
+	// writer preferring reader/writer lock with wait counters
+	struct __rw_lock_t
 	{
-		std::string escaped;
-		char *escape_control = curl_easy_escape(nullptr, value_to_escape.c_str(), value_to_escape.size());
-		escaped = escape_control;
-		curl_free(escape_control);
-		return escaped;
+		std::mutex mutex_;
+		std::condition_variable cond_;
+		int readers_ = 0;
+		int waiting_writers_ = 0;
+		bool writer_ = false;
+
+		std::atomic<uint64_t> acquired_{ 0 };
+		std::atomic<uint64_t> contended_{ 0 };
+		std::atomic<uint64_t> wait_ns_{ 0 };
+
+		void Lock(bool shared) {
+			std::unique_lock<std::mutex> lock(mutex_);
+			acquired_.fetch_add(1, std::memory_order_relaxed);
+
+			if (shared)
+			{
+				if (writer_ || waiting_writers_ > 0)
+				{
+					auto start = std::chrono::steady_clock::now();
+					cond_.wait(lock, [this] { return !writer_ && waiting_writers_ == 0; });
+					__count_wait(start);
+				}
+				++readers_;
+			}
+			else
+			{
+				if (writer_ || readers_ > 0)
+				{
+					auto start = std::chrono::steady_clock::now();
+					++waiting_writers_;
+					cond_.wait(lock, [this] { return !writer_ && readers_ == 0; });
+					--waiting_writers_;
+					__count_wait(start);
+				}
+				writer_ = true;
+			}
+		};
+
+		void Unlock() {
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				// the lock is held either by one writer or by readers only
+				if (writer_)
+				{
+					writer_ = false;
+				}
+				else
+				{
+					--readers_;
+				}
+			}
+			cond_.notify_all();
+		};
+
+		void __count_wait(std::chrono::steady_clock::time_point start) {
+			auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+			contended_.fetch_add(1, std::memory_order_relaxed);
+			wait_ns_.fetch_add(waited.count(), std::memory_order_relaxed);
+		};
+	};
+
+	struct __share_lock_t
+	{
+		__rw_lock_t locks_[CURL_LOCK_DATA_LAST];
+	};
+
+	Share::Share(bool connections)
+	{
+		// curl_global_init is not thread-safe, do it once before any shared handle is created
+		static CURLcode global_init = curl_global_init(CURL_GLOBAL_ALL);
+		(void)global_init;
+
+		_locks = std::make_shared<__share_lock_t>();
+		_share = curl_share_init();
+
+		if (_share)
+		{
+			curl_share_setopt(_share, CURLSHOPT_LOCKFUNC, &Share::__lock);
+			curl_share_setopt(_share, CURLSHOPT_UNLOCKFUNC, &Share::__unlock);
+			curl_share_setopt(_share, CURLSHOPT_USERDATA, _locks.get());
+
+			curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+			curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+			// shared connection cache since curl 7.57.0
+			if (connections)
+			{
+				curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+			}
+#endif
+		}
+	}
+
+	Share::~Share()
+	{
+		curl_share_cleanup(_share);
+	}
+
+	Share& Share::Default()
+	{
+		static Share share;
+		return share;
+	}
+
+	CURLSH* Share::Handle()
+	{
+		return _share;
+	}
+
+	ShareLockStats Share::LockStats(curl_lock_data data)
+	{
+		ShareLockStats stats{ 0, 0, 0 };
+		if (data >= 0 && data < CURL_LOCK_DATA_LAST)
+		{
+			auto& lock = _locks->locks_[data];
+			stats.acquired_ = lock.acquired_.load(std::memory_order_relaxed);
+			stats.contended_ = lock.contended_.load(std::memory_order_relaxed);
+			stats.wait_ns_ = lock.wait_ns_.load(std::memory_order_relaxed);
+		}
+		return stats;
+	}
+
+	void Share::__lock(CURL *, curl_lock_data data, curl_lock_access access, void *userptr)
+	{
+		auto locks = (__share_lock_t *)userptr;
+		locks->locks_[data].Lock(access == CURL_LOCK_ACCESS_SHARED);
 	}
 
+	void Share::__unlock(CURL *, curl_lock_data data, void *userptr)
+	{
+		auto locks = (__share_lock_t *)userptr;
+		locks->locks_[data].Unlock();
+	}
 
 	// ----------------------------------------------------------------------------------
 	//
-	//    Headers 
+	//    Pool
 	//
 	// ----------------------------------------------------------------------------------
 
-	Headers::Headers(std::string&& header_string)
+	Pool::Pool(size_t max_total, size_t max_per_host, long idle_timeout_ms)
+		: _max_total(max_total), _max_per_host(max_per_host), _idle_timeout_ms(idle_timeout_ms), _share(nullptr), _in_use(0) {}
+
+	Pool::~Pool()
 	{
-		__parse_http_header(header_string);
+		Clear();
 	}
 
-	Headers::Headers(std::string& header_string)
+	Pool& Pool::Default()
 	{
-		__parse_http_header(header_string);
+		// the share is constructed first so it outlives the pool's handles,
+		// it also runs curl_global_init before any handle is created
+		static Share& share = Share::Default();
+		static Pool pool;
+		static bool attached = (pool.SetShare(&share), true);
+		(void)attached;
+		return pool;
 	}
 
-	Headers::Headers(const std::initializer_list<Field>& headers)
+	void Pool::SetMaxTotal(size_t max_total)
 	{
-		for (const auto& header : headers)
+		std::lock_guard<std::mutex> lock(_mutex);
+		_max_total = max_total;
+		_handle_cond.notify_all();
+	}
+
+	void Pool::SetMaxPerHost(size_t max_per_host)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_max_per_host = max_per_host;
+		_host_cond.notify_all();
+	}
+
+	void Pool::SetIdleTimeout(long idle_timeout_ms)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_idle_timeout_ms = idle_timeout_ms;
+	}
+
+	void Pool::SetShare(Share* share)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_share = share;
+	}
+
+	void Pool::Clear()
+	{
+		std::vector<std::pair<CURLHandle*, clock_t::time_point>> idle;
 		{
-			_storage_headers[header.key_] = header.value_;
+			std::lock_guard<std::mutex> lock(_mutex);
+			idle.swap(_idle);
+		}
+
+		// closing connections may block, do it outside the lock
+		for (auto& pair : idle)
+		{
+			Session::__curl_handle_free(pair.first);
 		}
 	}
 
-	Headers::Headers(std::unordered_map<std::string, std::string>& map)
+	size_t Pool::IdleCount()
 	{
-		_storage_headers = map;
+		std::vector<CURLHandle*> expired;
+		size_t count;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			__collect_expired(expired);
+			count = _idle.size();
+		}
+
+		for (auto expired_handle : expired)
+		{
+			Session::__curl_handle_free(expired_handle);
+		}
+		return count;
 	}
 
-	curl_slist* Headers::Chunk()
+	size_t Pool::InUseCount()
 	{
-		struct curl_slist* chunk = nullptr;
-		for (auto itr = _storage_headers.cbegin(); itr != _storage_headers.cend(); ++itr) 
+		std::vector<CURLHandle*> expired;
+		size_t count;
 		{
-			auto header_string = std::string{ itr->first };
-			if (itr->second.empty()) 
+			std::lock_guard<std::mutex> lock(_mutex);
+			__collect_expired(expired);
+			count = _in_use;
+		}
+
+		for (auto expired_handle : expired)
+		{
+			Session::__curl_handle_free(expired_handle);
+		}
+		return count;
+	}
+
+	CURLHandle* Pool::__acquire()
+	{
+		std::vector<CURLHandle*> expired;
+		CURLHandle* handle = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			__collect_expired(expired);
+
+			_handle_cond.wait(lock, [this] {
+				return _in_use < _max_total;
+			});
+
+			++_in_use;
+
+			// the warmest handle is the most likely to hold a live connection
+			if (!_idle.empty())
 			{
-				header_string += ";";
+				handle = _idle.back().first;
+				_idle.pop_back();
 			}
-			else 
+		}
+
+		for (auto expired_handle : expired)
+		{
+			Session::__curl_handle_free(expired_handle);
+		}
+
+		if (!handle)
+		{
+			handle = Session::__curl_handle_init();
+			__attach_share(handle);
+		}
+
+		return handle;
+	}
+
+	void Pool::__release(CURLHandle* handle)
+	{
+		// request scoped state, live connections and caches survive curl_easy_reset
+		curl_slist_free_all(handle->chunk_);
+		handle->chunk_ = nullptr;
+		curl_mime_free(handle->mime_);
+		handle->mime_ = nullptr;
+		curl_easy_reset(handle->curl_);
+		// curl_easy_reset keeps the share, drop one a session attached itself
+		__attach_share(handle);
+
+		std::vector<CURLHandle*> expired;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			--_in_use;
+
+			if (_in_use + _idle.size() < _max_total)
 			{
-				header_string += ": " + itr->second;
+				_idle.emplace_back(handle, clock_t::now());
+				handle = nullptr;
 			}
-			chunk = curl_slist_append(chunk, header_string.data());
+
+			__collect_expired(expired);
+		}
+		_handle_cond.notify_one();
+
+		// pool is over its limit
+		if (handle)
+		{
+			Session::__curl_handle_free(handle);
+		}
+
+		for (auto expired_handle : expired)
+		{
+			Session::__curl_handle_free(expired_handle);
 		}
-		return chunk;
 	}
 
-	Headers& Headers::Merge(Headers& other)
+	void Pool::__acquire_host(const std::string& host)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		auto host_free = [this, &host] {
+			auto itr = _host_in_flight.find(host);
+			return itr == _host_in_flight.end() || itr->second < _max_per_host;
+		};
+		_host_cond.wait(lock, host_free);
+		++_host_in_flight[host];
+	}
+
+	void Pool::__release_host(const std::string& host)
 	{
-		for (const auto& pair : other._storage_headers)
 		{
-			_storage_headers.insert(pair);
+			std::lock_guard<std::mutex> lock(_mutex);
+			auto itr = _host_in_flight.find(host);
+			if (itr != _host_in_flight.end() && --itr->second == 0)
+			{
+				_host_in_flight.erase(itr);
+			}
 		}
-		return *this;
+		_host_cond.notify_all();
 	}
 
-	void Headers::__parse_http_header(std::string& header_string)
+	void Pool::__attach_share(CURLHandle* handle)
 	{
-		std::istringstream stream(header_string);
+		Share* share;
 		{
-			std::string line;
-			while (std::getline(stream, line, '\n'))
-			{
-				if (line.length() > 0)
-				{
-					auto found = line.find(":");
-					if (found != std::string::npos)
-					{
+			std::lock_guard<std::mutex> lock(_mutex);
+			share = _share;
+		}
 
-						auto value = line.substr(found + 1);
-						// erase space
-						value.erase(0, value.find_first_not_of("\t "));
-						value.resize((std::min)(value.size(), value.find_last_not_of("\t\n\r ") + 1));
+		if (handle->curl_)
+		{
+			curl_easy_setopt(handle->curl_, CURLOPT_SHARE, share ? share->Handle() : nullptr);
+		}
+	}
 
-						_storage_headers[line.substr(0, found)] = value;
+	void Pool::__collect_expired(std::vector<CURLHandle*>& expired)
+	{
+		auto deadline = clock_t::now() - std::chrono::milliseconds(_idle_timeout_ms);
 
-					}
-				}
-			}
+		// the oldest handles are at the front
+		auto itr = _idle.begin();
+		while (itr != _idle.end() && itr->second < deadline)
+		{
+			expired.push_back(itr->first);
+			++itr;
 		}
+		_idle.erase(_idle.begin(), itr);
 	}
 
-
 	// ----------------------------------------------------------------------------------
 	//
-	//    Response 
+	//    Engine
 	//
 	// ----------------------------------------------------------------------------------
 
-	Response::Response(int&& code, std::string&& body, Headers&& headers, std::string&& error)
-		: code_(code), body_(body), headers_(headers), error_(error) {}
+	// a udp socket connected to itself on loopback,
+	// curl_multi_wait watches it so another thread can wake the driver up
+	struct __wakeup_t
+	{
+		curl_socket_t socket_ = CURL_SOCKET_BAD;
+		std::atomic<bool> notified_{ false };
+
+		bool Open() {
+			socket_ = socket(AF_INET, SOCK_DGRAM, 0);
+			if (socket_ == CURL_SOCKET_BAD)
+			{
+				return false;
+			}
+
+			struct sockaddr_in addr;
+			memset(&addr, 0, sizeof(addr));
+			addr.sin_family = AF_INET;
+			addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			addr.sin_port = 0;
+
+			socklen_t len = sizeof(addr);
+			if (bind(socket_, (struct sockaddr *)&addr, len) != 0
+				|| getsockname(socket_, (struct sockaddr *)&addr, &len) != 0
+				|| connect(socket_, (struct sockaddr *)&addr, len) != 0)
+			{
+				Close();
+				return false;
+			}
+
+#ifdef _WIN32
+			u_long nonblocking = 1;
+			ioctlsocket(socket_, FIONBIO, &nonblocking);
+#else
+			fcntl(socket_, F_SETFL, fcntl(socket_, F_GETFL, 0) | O_NONBLOCK);
+#endif
+			return true;
+		};
+
+		void Notify() {
+			// one pending datagram is enough to wake the driver
+			if (!notified_.exchange(true))
+			{
+				char c = 0;
+				send(socket_, &c, 1, 0);
+			}
+		};
+
+		void Drain() {
+			notified_.store(false);
+			char buffer[64];
+			while (recv(socket_, buffer, sizeof(buffer), 0) > 0) {}
+		};
+
+		void Close() {
+			if (socket_ != CURL_SOCKET_BAD)
+			{
+#ifdef _WIN32
+				closesocket(socket_);
+#else
+				close(socket_);
+#endif
+				socket_ = CURL_SOCKET_BAD;
+			}
+		};
+	};
+
+	// node of the timing wheel, in a circular list with the slot heads as sentinels
+	struct __wheel_timer_t
+	{
+		__wheel_timer_t *prev_ = nullptr;
+		__wheel_timer_t *next_ = nullptr;
+		// in ticks of the wheel
+		uint64_t expires_ = 0;
+		void *data_ = nullptr;
+
+		bool Scheduled() { return next_ != nullptr; };
+	};
+
+	// hierarchical timing wheel with 1ms ticks, 4 levels of 256 slots reach about 49 days.
+	// scheduling and cancelling are O(1), a timer moves down a level at most 3 times before it fires
+	struct __timer_wheel_t
+	{
+		enum { __level_bits = 8, __slots = 1 << __level_bits, __levels = 4 };
+
+		std::chrono::steady_clock::time_point start_;
+		// the last tick advanced over
+		uint64_t now_ = 0;
+		size_t count_ = 0;
+		__wheel_timer_t slots_[__levels][__slots];
+
+		__timer_wheel_t() : start_(std::chrono::steady_clock::now()) {
+			for (auto& level : slots_)
+			{
+				for (auto& slot : level)
+				{
+					slot.prev_ = slot.next_ = &slot;
+				}
+			}
+		};
+
+		__timer_wheel_t(const __timer_wheel_t&) = delete;
+		__timer_wheel_t& operator=(const __timer_wheel_t&) = delete;
+
+		// rounded up, a timer never fires early
+		uint64_t Ticks(std::chrono::steady_clock::time_point time) {
+			auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time - start_).count();
+			return ns <= 0 ? 0 : ((uint64_t)ns + 999999) / 1000000;
+		};
+
+		void Schedule(__wheel_timer_t* timer, std::chrono::steady_clock::time_point time) {
+			Cancel(timer);
+			timer->expires_ = Ticks(time);
+			// a tick advanced over already is not visited again
+			__place(timer, now_ + 1);
+			++count_;
+		};
+
+		void Cancel(__wheel_timer_t* timer) {
+			if (timer->Scheduled())
+			{
+				__unlink(timer);
+				--count_;
+			}
+		};
+
+		// fire every timer up to the tick, the data of the fired ones is appended
+		template <typename T>
+		void Advance(uint64_t to, std::vector<T*>& fired) {
+			while (now_ < to)
+			{
+				if (!count_)
+				{
+					now_ = to;
+					break;
+				}
+
+				++now_;
+				auto index = now_ & (__slots - 1);
+				// the slot of the next level holding this tick, then the level above it at its wrap
+				for (size_t level = 1; !index && level < __levels; ++level)
+				{
+					index = (now_ >> (__level_bits * level)) & (__slots - 1);
+					__cascade(level, index);
+				}
+
+				auto& slot = slots_[0][now_ & (__slots - 1)];
+				while (slot.next_ != &slot)
+				{
+					auto timer = slot.next_;
+					__unlink(timer);
+					--count_;
+					fired.push_back((T*)timer->data_);
+				}
+			}
+		};
+
+		// milliseconds until the next timer fires or a level moves down, -1 without timers
+		int NextTimeout(std::chrono::steady_clock::time_point now) {
+			if (!count_)
+			{
+				return -1;
+			}
+
+			// level 0 up to the next cascade is exact
+			uint64_t limit = __slots - (now_ & (__slots - 1));
+			uint64_t ticks = 1;
+			for (; ticks < limit; ++ticks)
+			{
+				auto& slot = slots_[0][(now_ + ticks) & (__slots - 1)];
+				if (slot.next_ != &slot)
+				{
+					break;
+				}
+			}
+
+			auto at = start_ + std::chrono::milliseconds(now_ + ticks);
+			auto left = std::chrono::duration_cast<std::chrono::milliseconds>(at - now).count();
+			return (int)(std::max)(left, (decltype(left))0);
+		};
+
+		// in the lowest level whose range holds the timer, not earlier than the given tick
+		void __place(__wheel_timer_t* timer, uint64_t earliest) {
+			auto expires = (std::max)(timer->expires_, earliest);
+			auto delta = expires - now_;
+
+			size_t level = 0;
+			while (level + 1 < __levels && delta >= ((uint64_t)1 << (__level_bits * (level + 1))))
+			{
+				++level;
+			}
+
+			// beyond the top level, it comes down again once the wheel gets there
+			auto range = (uint64_t)1 << (__level_bits * __levels);
+			if (delta >= range)
+			{
+				expires = now_ + range - 1;
+			}
+
+			auto& slot = slots_[level][(expires >> (__level_bits * level)) & (__slots - 1)];
+			timer->prev_ = slot.prev_;
+			timer->next_ = &slot;
+			slot.prev_->next_ = timer;
+			slot.prev_ = timer;
+		};
+
+		void __unlink(__wheel_timer_t* timer) {
+			timer->prev_->next_ = timer->next_;
+			timer->next_->prev_ = timer->prev_;
+			timer->prev_ = timer->next_ = nullptr;
+		};
+
+		void __cascade(size_t level, size_t index) {
+			auto& slot = slots_[level][index];
+			// detach the list first, a timer may land in the same slot again
+			__wheel_timer_t list;
+			if (slot.next_ == &slot)
+			{
+				return;
+			}
+			list.next_ = slot.next_;
+			list.prev_ = slot.prev_;
+			list.next_->prev_ = &list;
+			list.prev_->next_ = &list;
+			slot.prev_ = slot.next_ = &slot;
+
+			while (list.next_ != &list)
+			{
+				auto timer = list.next_;
+				__unlink(timer);
+				// due this very tick, the current slot is fired right after
+				__place(timer, now_);
+			}
+		};
+	};
+
+	struct __loop_t;
+	struct __pending_origin_t;
+
+	struct __transfer_t
+	{
+		std::unique_ptr<Session> session_;
+		std::function<void(Response)> complete_;
+		// only the std::future api pays for a promise
+		std::unique_ptr<std::promise<void>> promise_;
+
+		// scheme://host:port, the shard key
+		std::string origin_;
+		// the entry of the origin in the queue of the loop that started it
+		__pending_origin_t *pending_origin_ = nullptr;
+
+		Priority priority_ = Priority::normal;
+
+		// submission order and time, for drop_oldest and the queue wait
+		uint64_t seq_ = 0;
+		std::chrono::steady_clock::time_point queued_at_;
+		// onto the multi handle and completed, for the transfer and the delivery time
+		std::chrono::steady_clock::time_point started_at_;
+		std::chrono::steady_clock::time_point finished_at_;
+
+		// kept until the executor delivers it
+		Response response_;
+
+		// subscription to the cancel token, 0 without one
+		uint64_t cancel_id_ = 0;
+		// the loop queueing or running it, where a cancellation goes
+		std::atomic<__loop_t*> loop_{ nullptr };
+
+		// fires at the deadline of the session, queued or running
+		__wheel_timer_t deadline_timer_;
+
+		// intrusive list of the transfers on the multi handle
+		__transfer_t *prev_ = nullptr;
+		__transfer_t *next_ = nullptr;
+		bool running_ = false;
+
+		// intrusive queue of the origin while waiting
+		__transfer_t *queue_prev_ = nullptr;
+		__transfer_t *queue_next_ = nullptr;
+	};
+
+	// fifo of waiting transfers, O(1) removal from the middle for cancellations and deadlines
+	struct __transfer_list_t
+	{
+		__transfer_t *head_ = nullptr;
+		__transfer_t *tail_ = nullptr;
+
+		bool Empty() { return head_ == nullptr; };
+		__transfer_t* Front() { return head_; };
+		__transfer_t* Back() { return tail_; };
+
+		void PushBack(__transfer_t* transfer) {
+			transfer->queue_prev_ = tail_;
+			transfer->queue_next_ = nullptr;
+			if (tail_)
+			{
+				tail_->queue_next_ = transfer;
+			}
+			else
+			{
+				head_ = transfer;
+			}
+			tail_ = transfer;
+		};
+
+		void Erase(__transfer_t* transfer) {
+			if (transfer->queue_prev_)
+			{
+				transfer->queue_prev_->queue_next_ = transfer->queue_next_;
+			}
+			else
+			{
+				head_ = transfer->queue_next_;
+			}
+			if (transfer->queue_next_)
+			{
+				transfer->queue_next_->queue_prev_ = transfer->queue_prev_;
+			}
+			else
+			{
+				tail_ = transfer->queue_prev_;
+			}
+			transfer->queue_prev_ = transfer->queue_next_ = nullptr;
+		};
+	};
+
+	struct __engine_t
+	{
+		std::mutex mutex_;
+		EngineConfig config_;
+		Share* share_ = nullptr;
+		bool started_ = false;
+
+		// fixed once started
+		std::vector<std::unique_ptr<__loop_t>> loops_;
+
+		std::atomic<size_t> in_flight_{ 0 };
+		std::atomic<uint64_t> submitted_{ 0 };
+		std::atomic<uint64_t> completed_{ 0 };
+		std::atomic<uint64_t> stolen_{ 0 };
+
+		// queue slots, taken on submission and given back once the transfer leaves the queue
+		std::atomic<size_t> queued_{ 0 };
+		std::atomic<size_t> queued_peak_{ 0 };
+		std::atomic<uint64_t> seq_{ 0 };
+		std::mutex slot_mutex_;
+		std::condition_variable slot_cond_;
+
+		std::atomic<uint64_t> dequeued_{ 0 };
+		std::atomic<uint64_t> queue_wait_ns_{ 0 };
+		std::atomic<uint64_t> blocked_{ 0 };
+		std::atomic<uint64_t> block_wait_ns_{ 0 };
+		std::atomic<uint64_t> rejected_{ 0 };
+		std::atomic<uint64_t> dropped_{ 0 };
+
+		std::atomic<uint64_t> transferred_{ 0 };
+		std::atomic<uint64_t> transfer_ns_{ 0 };
+		std::atomic<uint64_t> delivered_{ 0 };
+		std::atomic<uint64_t> delivery_wait_ns_{ 0 };
+		std::atomic<uint64_t> callback_ns_{ 0 };
+		std::atomic<uint64_t> callback_max_ns_{ 0 };
+		std::atomic<uint64_t> batches_{ 0 };
+
+		std::atomic<uint64_t> connects_{ 0 };
+		std::atomic<uint64_t> multiplexed_{ 0 };
+
+		// executor tasks not run yet, the engine waits for them when it stops
+		size_t delivering_ = 0;
+		std::mutex delivery_mutex_;
+		std::condition_variable delivery_cond_;
+
+		struct class_t
+		{
+			std::atomic<size_t> queued_{ 0 };
+			std::atomic<uint64_t> dequeued_{ 0 };
+			std::atomic<uint64_t> queue_wait_ns_{ 0 };
+			std::atomic<uint64_t> queue_wait_max_ns_{ 0 };
+		};
+		class_t classes_[HTTP_PRIORITY_COUNT];
+
+		void Start();
+		void Stop();
+		void Submit(__transfer_t* transfer);
+
+		// take queued transfers of the most loaded peer for an idle loop
+		bool Steal(__loop_t* thief, std::deque<__transfer_t*>& stolen);
+
+		// a queue slot for the transfer under the queue policy, false if it was rejected and completed
+		bool Reserve(__transfer_t* transfer);
+		void Release(__transfer_t* transfer);
+		// the transfer leaves the queue for the multi handle
+		void Started(__transfer_t* transfer);
+		// complete the oldest queued transfer as dropped, false if nothing is queued
+		bool DropOldest();
+
+		// the transfer is done, its completion runs now or is batched for the executor
+		void Finish(__transfer_t* transfer, Response resp);
+		void Fail(__transfer_t* transfer, ErrorCode code, const char* reason);
+		// hand completions to the executor as one task
+		void Post(std::vector<__transfer_t*> batch);
+		// run the completion and free the transfer
+		void Deliver(__transfer_t* transfer, Response resp);
+	};
+
+	// queued and running transfers of one origin on one loop
+	struct __pending_origin_t
+	{
+		// the key in __pending_t::origins_
+		const std::string *name_ = nullptr;
+		__transfer_list_t waiting_[HTTP_PRIORITY_COUNT];
+		size_t in_flight_ = 0;
+		// place in the ready list of each class with waiting transfers, while under the cap
+		std::list<__pending_origin_t*>::iterator ready_pos_[HTTP_PRIORITY_COUNT];
+		bool ready_[HTTP_PRIORITY_COUNT] = {};
+	};
+
+	// queued transfers of one loop, grouped by priority class and origin.
+	// classes are served by weighted round robin, the origins of a class take turns,
+	// an origin at its in flight cap sits out until one of its transfers completes
+	struct __pending_t
+	{
+		size_t max_per_origin_ = 0;
+		std::unordered_map<std::string, __pending_origin_t> origins_;
+		// origins with waiting transfers of the class and room to start one
+		std::list<__pending_origin_t*> ready_[HTTP_PRIORITY_COUNT];
+		// transfers each class may still start this round
+		size_t credits_[HTTP_PRIORITY_COUNT] = {};
+		size_t size_ = 0;
+
+		bool Empty() { return size_ == 0; };
+		size_t Size() { return size_; };
+
+		// a transfer can start now
+		bool Ready() {
+			for (auto& ready : ready_)
+			{
+				if (!ready.empty())
+				{
+					return true;
+				}
+			}
+			return false;
+		};
+
+		void Push(__transfer_t* transfer) {
+			auto itr = origins_.find(transfer->origin_);
+			if (itr == origins_.end())
+			{
+				itr = origins_.emplace(transfer->origin_, __pending_origin_t()).first;
+				itr->second.name_ = &itr->first;
+			}
+
+			auto origin = &itr->second;
+			auto cls = (size_t)transfer->priority_;
+			origin->waiting_[cls].PushBack(transfer);
+			transfer->pending_origin_ = origin;
+			++size_;
+
+			if (!__capped(origin))
+			{
+				__link(origin, cls);
+			}
+		};
+
+		// the next transfer to start, nullptr if every origin with waiting transfers is at its cap
+		__transfer_t* Pop(const size_t* weights) {
+			for (;;)
+			{
+				bool ready = false;
+				for (size_t i = 0; i < HTTP_PRIORITY_COUNT; ++i)
+				{
+					if (ready_[i].empty())
+					{
+						continue;
+					}
+					ready = true;
+					if (credits_[i] > 0)
+					{
+						--credits_[i];
+						return __take(i);
+					}
+				}
+
+				if (!ready)
+				{
+					return nullptr;
+				}
+
+				// every ready class has used its credits, the next round starts
+				for (size_t i = 0; i < HTTP_PRIORITY_COUNT; ++i)
+				{
+					credits_[i] = (std::max)(weights[i], (size_t)1);
+				}
+			}
+		};
+
+		// a transfer taken by Pop() completed
+		void Done(__transfer_t* transfer) {
+			auto origin = transfer->pending_origin_;
+			auto capped = __capped(origin);
+			--origin->in_flight_;
+
+			if (capped && !__capped(origin))
+			{
+				for (size_t i = 0; i < HTTP_PRIORITY_COUNT; ++i)
+				{
+					if (!origin->waiting_[i].Empty())
+					{
+						__link(origin, i);
+					}
+				}
+			}
+			__forget(origin);
+		};
+
+		// the least urgent transfer that could start, the lowest class from the back
+		__transfer_t* PopBack() {
+			for (size_t i = HTTP_PRIORITY_COUNT; i-- > 0;)
+			{
+				if (!ready_[i].empty())
+				{
+					auto origin = ready_[i].back();
+					auto transfer = origin->waiting_[i].Back();
+					origin->waiting_[i].Erase(transfer);
+					--size_;
+
+					if (origin->waiting_[i].Empty())
+					{
+						__unlink(origin, i);
+					}
+					__forget(origin);
+					return transfer;
+				}
+			}
+			return nullptr;
+		};
+
+		// the oldest transfer of the lowest class, the first one to drop
+		__transfer_t* Oldest() {
+			for (size_t i = HTTP_PRIORITY_COUNT; i-- > 0;)
+			{
+				__transfer_t *oldest = nullptr;
+				for (auto& itr : origins_)
+				{
+					auto& waiting = itr.second.waiting_[i];
+					if (!waiting.Empty() && (!oldest || waiting.Front()->seq_ < oldest->seq_))
+					{
+						oldest = waiting.Front();
+					}
+				}
+
+				if (oldest)
+				{
+					return oldest;
+				}
+			}
+			return nullptr;
+		};
+
+		// take a queued transfer out before it starts, O(1)
+		void Remove(__transfer_t* transfer) {
+			auto origin = transfer->pending_origin_;
+			auto cls = (size_t)transfer->priority_;
+			auto& waiting = origin->waiting_[cls];
+			waiting.Erase(transfer);
+			--size_;
+
+			if (waiting.Empty())
+			{
+				__unlink(origin, cls);
+			}
+			__forget(origin);
+		};
+
+		// every queued transfer, the running ones stay counted
+		void Drain(std::vector<__transfer_t*>& drained) {
+			for (auto& itr : origins_)
+			{
+				for (auto& waiting : itr.second.waiting_)
+				{
+					while (!waiting.Empty())
+					{
+						auto transfer = waiting.Front();
+						waiting.Erase(transfer);
+						drained.push_back(transfer);
+					}
+				}
+				for (size_t i = 0; i < HTTP_PRIORITY_COUNT; ++i)
+				{
+					itr.second.ready_[i] = false;
+				}
+			}
+			for (auto& ready : ready_)
+			{
+				ready.clear();
+			}
+			size_ = 0;
+		};
+
+		bool __capped(__pending_origin_t* origin) {
+			return max_per_origin_ && origin->in_flight_ >= max_per_origin_;
+		};
+
+		void __link(__pending_origin_t* origin, size_t cls) {
+			if (!origin->ready_[cls])
+			{
+				origin->ready_pos_[cls] = ready_[cls].insert(ready_[cls].end(), origin);
+				origin->ready_[cls] = true;
+			}
+		};
+
+		void __unlink(__pending_origin_t* origin, size_t cls) {
+			if (origin->ready_[cls])
+			{
+				ready_[cls].erase(origin->ready_pos_[cls]);
+				origin->ready_[cls] = false;
+			}
+		};
+
+		__transfer_t* __take(size_t cls) {
+			auto origin = ready_[cls].front();
+			auto transfer = origin->waiting_[cls].Front();
+			origin->waiting_[cls].Erase(transfer);
+			--size_;
+			++origin->in_flight_;
+
+			if (origin->waiting_[cls].Empty())
+			{
+				__unlink(origin, cls);
+			}
+			else
+			{
+				// the origin goes to the back of its class
+				ready_[cls].splice(ready_[cls].end(), ready_[cls], origin->ready_pos_[cls]);
+			}
+
+			if (__capped(origin))
+			{
+				for (size_t i = 0; i < HTTP_PRIORITY_COUNT; ++i)
+				{
+					__unlink(origin, i);
+				}
+			}
+			return transfer;
+		};
+
+		// drop the entry of an origin with nothing queued or running
+		void __forget(__pending_origin_t* origin) {
+			if (origin->in_flight_)
+			{
+				return;
+			}
+			for (auto& waiting : origin->waiting_)
+			{
+				if (!waiting.Empty())
+				{
+					return;
+				}
+			}
+			origins_.erase(std::string(*origin->name_));
+		};
+	};
+
+	// the loop running on this thread, submissions from completions must not block on the queue
+	static thread_local __loop_t* __current_loop = nullptr;
+
+	// one event loop thread with its own curl_multi handle and connection cache
+	struct __loop_t
+	{
+		__engine_t *engine_ = nullptr;
+		CURLM *multi_ = nullptr;
+		__wakeup_t wakeup_;
+
+		std::mutex mutex_;
+		// submitted, not added to the multi handle yet
+		__pending_t pending_;
+		bool stop_ = false;
+
+		// read by peers without the lock to pick a loop
+		std::atomic<size_t> pending_count_{ 0 };
+		std::atomic<size_t> running_count_{ 0 };
+
+		std::thread thread_;
+
+		// transfers with a cancel token on this loop by sequence number, and the cancelled ones
+		std::unordered_map<uint64_t, __transfer_t*> cancellable_;
+		std::vector<uint64_t> cancelled_;
+
+		// deadlines of the queued and running transfers
+		__timer_wheel_t timers_;
+
+		// driver thread only
+		__transfer_t *running_ = nullptr;
+		std::vector<__transfer_t*> admitted_;
+		std::vector<__transfer_t*> expired_;
+		// cancelled or past their deadline
+		std::vector<std::pair<__transfer_t*, ErrorCode>> stopped_running_;
+		std::vector<std::pair<__transfer_t*, ErrorCode>> stopped_queued_;
+		// completed in this pass, for the executor
+		std::vector<__transfer_t*> deliveries_;
+
+		// connections and transfers on the multi handle by origin, an entry goes with the last of them
+		struct __origin_usage_t
+		{
+			// the key in usage_
+			const std::string *name_ = nullptr;
+			// sockets curl watches on the epoll backend, one per connection of the running transfers
+			size_t connections_ = 0;
+			size_t streams_ = 0;
+		};
+		std::mutex usage_mutex_;
+		std::unordered_map<std::string, __origin_usage_t> usage_;
+
+		void Start() {
+			pending_.max_per_origin_ = engine_->config_.max_per_origin_;
+			multi_ = curl_multi_init();
+
+			curl_multi_setopt(multi_, CURLMOPT_PIPELINING, engine_->config_.multiplex_ ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+			curl_multi_setopt(multi_, CURLMOPT_MAX_HOST_CONNECTIONS, (long)engine_->config_.max_connections_per_origin_);
+#if LIBCURL_VERSION_NUM >= 0x074300
+			if (engine_->config_.max_streams_)
+			{
+				curl_multi_setopt(multi_, CURLMOPT_MAX_CONCURRENT_STREAMS, (long)engine_->config_.max_streams_);
+			}
+#endif
+			wakeup_.Open();
+			thread_ = std::thread(&__loop_t::Run, this);
+		};
+
+		void Stop() {
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				stop_ = true;
+			}
+			wakeup_.Notify();
+			thread_.join();
+
+			wakeup_.Close();
+			curl_multi_cleanup(multi_);
+		};
+
+		void Push(__transfer_t* transfer) {
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				pending_.Push(transfer);
+				pending_count_.store(pending_.Size());
+				Track(transfer);
+			}
+			wakeup_.Notify();
+		};
+
+		// cancellations and the deadline reach the transfer on this loop, the lock is held
+		void Track(__transfer_t* transfer) {
+			if (transfer->cancel_id_)
+			{
+				cancellable_[transfer->seq_] = transfer;
+			}
+			if (transfer->session_->_deadline.value_ != std::chrono::steady_clock::time_point())
+			{
+				timers_.Schedule(&transfer->deadline_timer_, transfer->session_->_deadline.value_);
+			}
+			// before the token is checked on admission, a cancellation finds this loop or is seen there
+			transfer->loop_.store(this);
+		};
+
+		// the entry of an origin, usage_mutex_ is held
+		__origin_usage_t* Usage(const std::string& origin) {
+			auto itr = usage_.find(origin);
+			if (itr == usage_.end())
+			{
+				itr = usage_.emplace(origin, __origin_usage_t()).first;
+				itr->second.name_ = &itr->first;
+			}
+			return &itr->second;
+		};
+
+		// drop the entry of an origin without connections or transfers, usage_mutex_ is held
+		void Forget(__origin_usage_t* usage) {
+			if (!usage->connections_ && !usage->streams_)
+			{
+				usage_.erase(std::string(*usage->name_));
+			}
+		};
+
+		// from the cancel token, the transfer is looked up again on the loop thread
+		void Cancel(uint64_t seq) {
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				cancelled_.push_back(seq);
+			}
+			wakeup_.Notify();
+		};
+
+		// take up to half of the queued transfers from the back, the front is about to start anyway
+		void Give(std::deque<__transfer_t*>& stolen) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			auto count = pending_.Size() / 2;
+			for (size_t i = 0; i < count; ++i)
+			{
+				// origins at their cap keep their transfers, a thief would run past the cap
+				auto transfer = pending_.PopBack();
+				if (!transfer)
+				{
+					break;
+				}
+				Untrack(transfer);
+				stolen.push_back(transfer);
+			}
+			pending_count_.store(pending_.Size());
+		};
+
+		// the transfer to drop first if it is still the one with this sequence number
+		__transfer_t* TakeOldest(uint64_t seq) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			auto transfer = pending_.Oldest();
+			if (!transfer || transfer->seq_ != seq)
+			{
+				return nullptr;
+			}
+			pending_.Remove(transfer);
+			pending_count_.store(pending_.Size());
+			Untrack(transfer);
+			return transfer;
+		};
+
+		// free transfer slots for the queue
+		size_t Room() {
+			auto cap = engine_->config_.max_transfers_;
+			if (!cap)
+			{
+				return SIZE_MAX;
+			}
+			auto running = running_count_.load();
+			return cap > running ? cap - running : 0;
+		};
+
+		// queued transfers can start now, the loop must not sleep
+		bool Admissible() {
+			if (pending_count_.load() == 0 || Room() == 0)
+			{
+				return false;
+			}
+			std::lock_guard<std::mutex> lock(mutex_);
+			return pending_.Ready();
+		};
+
+		// the origin of a started transfer has room again
+		void Done(__transfer_t* transfer) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			pending_.Done(transfer);
+			Untrack(transfer);
+		};
+
+		// no cancellation or deadline reaches the transfer on this loop any more, the lock is held
+		void Untrack(__transfer_t* transfer) {
+			if (transfer->cancel_id_)
+			{
+				cancellable_.erase(transfer->seq_);
+			}
+			timers_.Cancel(&transfer->deadline_timer_);
+		};
+
+		// milliseconds until the next deadline, -1 without one
+		int NextTimeout() {
+			std::lock_guard<std::mutex> lock(mutex_);
+			return timers_.NextTimeout(std::chrono::steady_clock::now());
+		};
+
+		// the loop sleeps no longer than the next deadline
+		int WaitTimeout(int timeout_ms) {
+			auto next = NextTimeout();
+			if (next < 0)
+			{
+				return timeout_ms;
+			}
+			return timeout_ms < 0 ? next : (std::min)(timeout_ms, next);
+		};
+
+		void Run() {
+			__current_loop = this;
+
+#ifdef __linux__
+			if (engine_->config_.backend_ == EngineBackend::epoll)
+			{
+				RunEpoll();
+			}
+			else
+#endif
+			{
+				RunPoll();
+			}
+
+			// transfers still on the multi handle
+			while (running_)
+			{
+				auto transfer = running_;
+				Remove(transfer);
+				engine_->Fail(transfer, ErrorCode::aborted, "engine stopped");
+			}
+			Flush();
+
+			__current_loop = nullptr;
+		};
+
+		// the completions of this pass go to the executor together
+		void Flush() {
+			if (!deliveries_.empty())
+			{
+				engine_->Post(HTTP_MOVE(deliveries_));
+				deliveries_.clear();
+			}
+		};
+
+		// take a cancelled or expired transfer off the queue, a running one off the multi handle after the lock
+		void Stopped(__transfer_t* transfer, ErrorCode code) {
+			Untrack(transfer);
+			if (transfer->running_)
+			{
+				stopped_running_.emplace_back(transfer, code);
+			}
+			else
+			{
+				pending_.Remove(transfer);
+				pending_count_.store(pending_.Size());
+				stopped_queued_.emplace_back(transfer, code);
+			}
+		};
+
+		// move queued transfers onto the multi handle while there is room, false once the loop stops
+		bool TakePending() {
+			if (pending_count_.load() == 0 && running_count_.load() == 0)
+			{
+				std::deque<__transfer_t*> stolen;
+				if (engine_->Steal(this, stolen))
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					ErrorCode code;
+					for (auto transfer : stolen)
+					{
+						pending_.Push(transfer);
+						Track(transfer);
+						// the deadline may have passed on the way, and a cancellation meanwhile went to the
+						// victim and found nothing there, the later ones find this loop
+						if (transfer->session_->__stopped(code))
+						{
+							Stopped(transfer, code);
+						}
+					}
+					pending_count_.store(pending_.Size());
+				}
+			}
+
+			bool stop;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				stop = stop_;
+
+				timers_.Advance(timers_.Ticks(std::chrono::steady_clock::now()), expired_);
+				for (auto transfer : expired_)
+				{
+					Stopped(transfer, ErrorCode::deadline);
+				}
+				expired_.clear();
+
+				for (auto seq : cancelled_)
+				{
+					// completed or expired meanwhile, or stolen, the thief checks the token once it tracks the transfer
+					auto itr = cancellable_.find(seq);
+					if (itr != cancellable_.end())
+					{
+						Stopped(itr->second, ErrorCode::cancelled);
+					}
+				}
+				cancelled_.clear();
+
+				if (stop)
+				{
+					pending_.Drain(admitted_);
+					for (auto transfer : admitted_)
+					{
+						Untrack(transfer);
+					}
+				}
+				else
+				{
+					for (auto room = Room(); room > 0; --room)
+					{
+						auto transfer = pending_.Pop(engine_->config_.priority_weights_);
+						if (!transfer)
+						{
+							break;
+						}
+						admitted_.push_back(transfer);
+					}
+				}
+				pending_count_.store(pending_.Size());
+			}
+
+			// the connection goes away with the easy handle, nothing more is read for it
+			for (auto& stopped : stopped_running_)
+			{
+				Remove(stopped.first);
+				engine_->Fail(stopped.first, stopped.second, priv::util::__stop_reason(stopped.second));
+			}
+			stopped_running_.clear();
+
+			for (auto& stopped : stopped_queued_)
+			{
+				engine_->Release(stopped.first);
+				engine_->Fail(stopped.first, stopped.second, priv::util::__stop_reason(stopped.second));
+			}
+			stopped_queued_.clear();
+
+			ErrorCode code;
+			for (auto transfer : admitted_)
+			{
+				if (stop)
+				{
+					engine_->Release(transfer);
+					engine_->Fail(transfer, ErrorCode::aborted, "engine stopped");
+				}
+				else if (transfer->session_->__stopped(code))
+				{
+					// cancelled before it got here or expired in the queue
+					engine_->Release(transfer);
+					Done(transfer);
+					engine_->Fail(transfer, code, priv::util::__stop_reason(code));
+				}
+				else
+				{
+					engine_->Started(transfer);
+					Add(transfer);
+				}
+			}
+			admitted_.clear();
+			return !stop;
+		};
+
+		// curl_multi_wait rescans every transfer on each wakeup
+		void RunPoll() {
+			while (TakePending())
+			{
+				int still_running = 0;
+				curl_multi_perform(multi_, &still_running);
+				Complete();
+				Flush();
+
+				// curl caps the timeout with its own next timer,
+				// without a wakeup socket submissions are picked up by polling
+				struct curl_waitfd waitfd;
+				waitfd.fd = wakeup_.socket_;
+				waitfd.events = CURL_WAIT_POLLIN;
+				waitfd.revents = 0;
+				auto has_wakeup = wakeup_.socket_ != CURL_SOCKET_BAD;
+				auto timeout_ms = Admissible() ? 0 : WaitTimeout(has_wakeup ? 1000 : 10);
+				curl_multi_wait(multi_, &waitfd, has_wakeup ? 1 : 0, timeout_ms, nullptr);
+				wakeup_.Drain();
+			}
+		};
+
+#ifdef __linux__
+		int epoll_ = -1;
+		bool timer_armed_ = false;
+		std::chrono::steady_clock::time_point timer_deadline_;
+
+		// curl_multi_socket_action on epoll, only the ready sockets do work
+		void RunEpoll() {
+			epoll_ = epoll_create1(EPOLL_CLOEXEC);
+			if (epoll_ < 0)
+			{
+				RunPoll();
+				return;
+			}
+
+			curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, &__loop_t::__socket_function);
+			curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, this);
+			curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, &__loop_t::__timer_function);
+			curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, this);
+
+			auto has_wakeup = wakeup_.socket_ != CURL_SOCKET_BAD;
+			if (has_wakeup)
+			{
+				struct epoll_event event;
+				memset(&event, 0, sizeof(event));
+				event.events = EPOLLIN;
+				event.data.fd = wakeup_.socket_;
+				epoll_ctl(epoll_, EPOLL_CTL_ADD, wakeup_.socket_, &event);
+			}
+
+			std::vector<struct epoll_event> events(256);
+			int still_running = 0;
+
+			while (TakePending())
+			{
+				int timeout_ms = Admissible() ? 0 : WaitTimeout(has_wakeup ? -1 : 10);
+				if (timer_armed_)
+				{
+					auto left = std::chrono::duration_cast<std::chrono::milliseconds>(timer_deadline_ - std::chrono::steady_clock::now()).count();
+					left = (std::max)(left, (decltype(left))0);
+					timeout_ms = timeout_ms < 0 ? (int)left : (std::min)(timeout_ms, (int)left);
+				}
+
+				int count = epoll_wait(epoll_, events.data(), (int)events.size(), timeout_ms);
+				for (int i = 0; i < count; ++i)
+				{
+					auto fd = events[i].data.fd;
+					if (fd == wakeup_.socket_)
+					{
+						wakeup_.Drain();
+						continue;
+					}
+
+					int flags = 0;
+					if (events[i].events & EPOLLIN) flags |= CURL_CSELECT_IN;
+					if (events[i].events & EPOLLOUT) flags |= CURL_CSELECT_OUT;
+					if (events[i].events & (EPOLLERR | EPOLLHUP)) flags |= CURL_CSELECT_ERR;
+					curl_multi_socket_action(multi_, fd, flags, &still_running);
+				}
+
+				if (timer_armed_ && std::chrono::steady_clock::now() >= timer_deadline_)
+				{
+					// the timer function may arm it again
+					timer_armed_ = false;
+					curl_multi_socket_action(multi_, CURL_SOCKET_TIMEOUT, 0, &still_running);
+				}
+
+				Complete();
+				Flush();
+			}
+
+			close(epoll_);
+			epoll_ = -1;
+		};
+
+		static int __socket_function(CURL *curl, curl_socket_t socket, int what, void *userp, void *socketp) {
+			auto loop = (__loop_t *)userp;
+
+			if (what == CURL_POLL_REMOVE)
+			{
+				// the socket may be closed already, the error doesn't matter
+				epoll_ctl(loop->epoll_, EPOLL_CTL_DEL, socket, nullptr);
+				if (socketp)
+				{
+					std::lock_guard<std::mutex> lock(loop->usage_mutex_);
+					auto usage = (__origin_usage_t *)socketp;
+					--usage->connections_;
+					loop->Forget(usage);
+				}
+				return 0;
+			}
+
+			struct epoll_event event;
+			memset(&event, 0, sizeof(event));
+			event.events = ((what & CURL_POLL_IN) ? (uint32_t)EPOLLIN : 0) | ((what & CURL_POLL_OUT) ? (uint32_t)EPOLLOUT : 0);
+			event.data.fd = socket;
+
+			if (!socketp)
+			{
+				// a reused descriptor may still be registered
+				if (epoll_ctl(loop->epoll_, EPOLL_CTL_ADD, socket, &event) != 0 && errno == EEXIST)
+				{
+					epoll_ctl(loop->epoll_, EPOLL_CTL_MOD, socket, &event);
+				}
+				// the connection counts for the origin of the transfer that opened it
+				__transfer_t *transfer = nullptr;
+				curl_easy_getinfo(curl, CURLINFO_PRIVATE, &transfer);
+				std::lock_guard<std::mutex> lock(loop->usage_mutex_);
+				auto usage = loop->Usage(transfer ? transfer->origin_ : std::string());
+				++usage->connections_;
+				curl_multi_assign(loop->multi_, socket, usage);
+			}
+			else
+			{
+				epoll_ctl(loop->epoll_, EPOLL_CTL_MOD, socket, &event);
+			}
+			return 0;
+		};
+
+		static int __timer_function(CURLM *, long timeout_ms, void *userp) {
+			auto loop = (__loop_t *)userp;
+
+			// -1 deletes the timer
+			loop->timer_armed_ = timeout_ms >= 0;
+			if (loop->timer_armed_)
+			{
+				loop->timer_deadline_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+			}
+			return 0;
+		};
+#endif
+
+		void Add(__transfer_t* transfer) {
+			auto curl = transfer->session_->_curl_handle_ptr->curl_;
+			transfer->session_->__prepare(curl);
+			curl_easy_setopt(curl, CURLOPT_PRIVATE, transfer);
+			// wait for a connection being set up to the origin when it may turn out to multiplex,
+			// on plain http/1.1 every transfer would wait for the one before it
+			curl_easy_setopt(curl, CURLOPT_PIPEWAIT, engine_->config_.multiplex_ && MayMultiplex(transfer) ? 1L : 0L);
+			if (curl_multi_add_handle(multi_, curl) != CURLM_OK)
+			{
+				Done(transfer);
+				engine_->Fail(transfer, ErrorCode::curl, "curl_multi_add_handle failed");
+				return;
+			}
+
+			transfer->next_ = running_;
+			if (running_)
+			{
+				running_->prev_ = transfer;
+			}
+			running_ = transfer;
+			transfer->running_ = true;
+			running_count_.fetch_add(1);
+
+			std::lock_guard<std::mutex> lock(usage_mutex_);
+			++Usage(transfer->origin_)->streams_;
+		};
+
+		// http/2 over tls, or h2c the session asked for
+		static bool MayMultiplex(__transfer_t* transfer) {
+			auto version = transfer->session_->_http_version;
+			if (version == HttpVersion::http2_prior_knowledge)
+			{
+				return true;
+			}
+			return version != HttpVersion::http1_1 && transfer->origin_.compare(0, 8, "https://") == 0;
+		};
+
+		void Remove(__transfer_t* transfer) {
+			curl_multi_remove_handle(multi_, transfer->session_->_curl_handle_ptr->curl_);
+
+			if (transfer->prev_)
+			{
+				transfer->prev_->next_ = transfer->next_;
+			}
+			else
+			{
+				running_ = transfer->next_;
+			}
+			if (transfer->next_)
+			{
+				transfer->next_->prev_ = transfer->prev_;
+			}
+			transfer->prev_ = transfer->next_ = nullptr;
+			transfer->running_ = false;
+			running_count_.fetch_sub(1);
+			{
+				std::lock_guard<std::mutex> lock(usage_mutex_);
+				auto usage = Usage(transfer->origin_);
+				--usage->streams_;
+				Forget(usage);
+			}
+			Done(transfer);
+		};
+
+		void Complete() {
+			CURLMsg *msg = nullptr;
+			int left = 0;
+			while ((msg = curl_multi_info_read(multi_, &left)))
+			{
+				if (msg->msg != CURLMSG_DONE)
+				{
+					continue;
+				}
+
+				auto curl = msg->easy_handle;
+				auto res = msg->data.result;
+				__transfer_t *transfer = nullptr;
+				curl_easy_getinfo(curl, CURLINFO_PRIVATE, &transfer);
+
+				long connects = 0;
+				long version = 0;
+				curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+				curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION, &version);
+				engine_->connects_.fetch_add(connects, std::memory_order_relaxed);
+				if (version == CURL_HTTP_VERSION_2_0)
+				{
+					engine_->multiplexed_.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				Remove(transfer);
+
+				engine_->Finish(transfer, transfer->session_->__response(curl, res));
+			}
+		};
+	};
+
+	void __engine_t::Start()
+	{
+		// started by the first submission, the caller holds the lock
+		if (started_)
+		{
+			return;
+		}
+		started_ = true;
+
+		auto threads = (std::max)(config_.threads_, (size_t)1);
+		for (size_t i = 0; i < threads; ++i)
+		{
+			std::unique_ptr<__loop_t> loop(new __loop_t());
+			loop->engine_ = this;
+			loops_.push_back(HTTP_MOVE(loop));
+		}
+
+		for (auto& loop : loops_)
+		{
+			loop->Start();
+		}
+	}
+
+	void __engine_t::Stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (!started_)
+			{
+				return;
+			}
+		}
+
+		for (auto& loop : loops_)
+		{
+			loop->Stop();
+		}
+
+		// the transfers of the tasks still with the executor point back here
+		std::unique_lock<std::mutex> lock(delivery_mutex_);
+		delivery_cond_.wait(lock, [this] {
+			return delivering_ == 0;
+		});
+	}
+
+	void __engine_t::Submit(__transfer_t* transfer)
+	{
+		// requests of one origin go to one loop, so its connections stay local
+		auto shard = std::hash<std::string>()(transfer->origin_) % loops_.size();
+		auto loop = loops_[shard].get();
+		loop->Push(transfer);
+
+		// the shard falls behind, wake the least loaded loop up to steal
+		if (loops_.size() > 1 && loop->pending_count_.load() >= config_.steal_threshold_)
+		{
+			__loop_t *idle = nullptr;
+			for (auto& peer : loops_)
+			{
+				if (peer->pending_count_.load() == 0 && (!idle || peer->running_count_.load() < idle->running_count_.load()))
+				{
+					idle = peer.get();
+				}
+			}
+
+			if (idle && idle != loop)
+			{
+				idle->wakeup_.Notify();
+			}
+		}
+	}
+
+	bool __engine_t::Steal(__loop_t* thief, std::deque<__transfer_t*>& stolen)
+	{
+		if (loops_.size() < 2)
+		{
+			return false;
+		}
+
+		__loop_t *victim = nullptr;
+		for (auto& peer : loops_)
+		{
+			if (peer.get() != thief && peer->pending_count_.load() >= config_.steal_threshold_
+				&& (!victim || peer->pending_count_.load() > victim->pending_count_.load()))
+			{
+				victim = peer.get();
+			}
+		}
+
+		if (!victim)
+		{
+			return false;
+		}
+
+		victim->Give(stolen);
+		stolen_.fetch_add(stolen.size(), std::memory_order_relaxed);
+		return !stolen.empty();
+	}
+
+	bool __engine_t::Reserve(__transfer_t* transfer)
+	{
+		auto capacity = config_.queue_capacity_;
+		bool blocked = false;
+		std::chrono::steady_clock::time_point block_start;
+
+		auto queued = queued_.load();
+		for (;;)
+		{
+			// waiting on a loop thread may wait on itself, it queues past the capacity instead
+			if (!capacity || queued < capacity || (config_.queue_policy_ == QueuePolicy::block && __current_loop))
+			{
+				if (queued_.compare_exchange_weak(queued, queued + 1))
+				{
+					++queued;
+					break;
+				}
+				continue;
+			}
+
+			if (config_.queue_policy_ == QueuePolicy::reject)
+			{
+				rejected_.fetch_add(1, std::memory_order_relaxed);
+				Fail(transfer, ErrorCode::rejected, "engine queue is full");
+				return false;
+			}
+
+			if (config_.queue_policy_ == QueuePolicy::drop_oldest)
+			{
+				// nothing to drop while the slots belong to submissions not pushed yet
+				if (!DropOldest())
+				{
+					std::this_thread::yield();
+				}
+			}
+			else
+			{
+				if (!blocked)
+				{
+					blocked = true;
+					block_start = std::chrono::steady_clock::now();
+				}
+				std::unique_lock<std::mutex> lock(slot_mutex_);
+				slot_cond_.wait(lock, [&] { return queued_.load() < capacity; });
+			}
+			queued = queued_.load();
+		}
+
+		if (blocked)
+		{
+			blocked_.fetch_add(1, std::memory_order_relaxed);
+			block_wait_ns_.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - block_start).count(), std::memory_order_relaxed);
+		}
+
+		auto peak = queued_peak_.load();
+		while (peak < queued && !queued_peak_.compare_exchange_weak(peak, queued))
+		{
+		}
+		classes_[(size_t)transfer->priority_].queued_.fetch_add(1);
+
+		transfer->seq_ = seq_.fetch_add(1);
+		transfer->queued_at_ = std::chrono::steady_clock::now();
+		return true;
+	}
+
+	void __engine_t::Release(__transfer_t* transfer)
+	{
+		classes_[(size_t)transfer->priority_].queued_.fetch_sub(1);
+		queued_.fetch_sub(1);
+		if (config_.queue_capacity_ && config_.queue_policy_ == QueuePolicy::block)
+		{
+			// under the lock, so a waiter can't miss it between its check and its wait
+			std::lock_guard<std::mutex> lock(slot_mutex_);
+			slot_cond_.notify_one();
+		}
+	}
+
+	void __engine_t::Started(__transfer_t* transfer)
+	{
+		Release(transfer);
+
+		transfer->started_at_ = std::chrono::steady_clock::now();
+		uint64_t wait = std::chrono::duration_cast<std::chrono::nanoseconds>(transfer->started_at_ - transfer->queued_at_).count();
+		dequeued_.fetch_add(1, std::memory_order_relaxed);
+		queue_wait_ns_.fetch_add(wait, std::memory_order_relaxed);
+
+		auto& cls = classes_[(size_t)transfer->priority_];
+		cls.dequeued_.fetch_add(1, std::memory_order_relaxed);
+		cls.queue_wait_ns_.fetch_add(wait, std::memory_order_relaxed);
+		auto max = cls.queue_wait_max_ns_.load(std::memory_order_relaxed);
+		while (max < wait && !cls.queue_wait_max_ns_.compare_exchange_weak(max, wait, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	bool __engine_t::DropOldest()
+	{
+		// the lowest class first, then the oldest
+		__loop_t *oldest = nullptr;
+		Priority priority = Priority::high;
+		uint64_t seq = 0;
+		for (auto& loop : loops_)
+		{
+			std::lock_guard<std::mutex> lock(loop->mutex_);
+			auto transfer = loop->pending_.Oldest();
+			if (transfer && (!oldest || transfer->priority_ > priority || (transfer->priority_ == priority && transfer->seq_ < seq)))
+			{
+				oldest = loop.get();
+				priority = transfer->priority_;
+				seq = transfer->seq_;
+			}
+		}
+
+		if (!oldest)
+		{
+			return false;
+		}
+
+		// started or dropped meanwhile, the caller checks the queue again
+		auto transfer = oldest->TakeOldest(seq);
+		if (transfer)
+		{
+			Release(transfer);
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+			Fail(transfer, ErrorCode::dropped, "dropped from the engine queue");
+		}
+		return true;
+	}
+
+	void __engine_t::Finish(__transfer_t* transfer, Response resp)
+	{
+		// waits for a cancellation running on another thread, it may still reach the loop
+		if (transfer->cancel_id_)
+		{
+			transfer->session_->_cancel->Unsubscribe(transfer->cancel_id_);
+		}
+
+		transfer->finished_at_ = std::chrono::steady_clock::now();
+		if (transfer->started_at_ != std::chrono::steady_clock::time_point())
+		{
+			transferred_.fetch_add(1, std::memory_order_relaxed);
+			transfer_ns_.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(transfer->finished_at_ - transfer->started_at_).count(), std::memory_order_relaxed);
+		}
+
+		if (!config_.executor_)
+		{
+			Deliver(transfer, HTTP_MOVE(resp));
+			return;
+		}
+
+		transfer->response_ = HTTP_MOVE(resp);
+		auto loop = __current_loop;
+		if (loop && loop->engine_ == this)
+		{
+			// flushed at the end of the pass
+			loop->deliveries_.push_back(transfer);
+			if (config_.completion_batch_ && loop->deliveries_.size() >= config_.completion_batch_)
+			{
+				loop->Flush();
+			}
+		}
+		else
+		{
+			// failed on the submitting thread
+			Post(std::vector<__transfer_t*>(1, transfer));
+		}
+	}
+
+	void __engine_t::Post(std::vector<__transfer_t*> batch)
+	{
+		batches_.fetch_add(1, std::memory_order_relaxed);
+		{
+			std::lock_guard<std::mutex> lock(delivery_mutex_);
+			++delivering_;
+		}
+
+		auto engine = this;
+		config_.executor_([engine, batch]() {
+			for (auto transfer : batch)
+			{
+				engine->Deliver(transfer, HTTP_MOVE(transfer->response_));
+			}
+
+			std::lock_guard<std::mutex> lock(engine->delivery_mutex_);
+			if (--engine->delivering_ == 0)
+			{
+				engine->delivery_cond_.notify_all();
+			}
+		});
+	}
+
+	void __engine_t::Deliver(__transfer_t* transfer, Response resp)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		// counted before any waiter wakes up, a caller back from Get() sees its transfer done
+		in_flight_.fetch_sub(1);
+		completed_.fetch_add(1, std::memory_order_relaxed);
+
+		std::exception_ptr exception;
+		try
+		{
+			if (transfer->complete_)
+			{
+				transfer->complete_(HTTP_MOVE(resp));
+			}
+		}
+		catch (...)
+		{
+			// surfaces through the future like std::async did
+			exception = std::current_exception();
+		}
+
+		auto end = std::chrono::steady_clock::now();
+		uint64_t callback = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+		delivered_.fetch_add(1, std::memory_order_relaxed);
+		delivery_wait_ns_.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(start - transfer->finished_at_).count(), std::memory_order_relaxed);
+		callback_ns_.fetch_add(callback, std::memory_order_relaxed);
+		auto max = callback_max_ns_.load(std::memory_order_relaxed);
+		while (max < callback && !callback_max_ns_.compare_exchange_weak(max, callback, std::memory_order_relaxed))
+		{
+		}
+
+		if (transfer->promise_)
+		{
+			if (exception)
+			{
+				transfer->promise_->set_exception(exception);
+			}
+			else
+			{
+				transfer->promise_->set_value();
+			}
+		}
+		delete transfer;
+	}
+
+	void __engine_t::Fail(__transfer_t* transfer, ErrorCode code, const char* reason)
+	{
+		Finish(transfer, priv::util::__error_response(code, reason));
+	}
+
+	Engine::Engine(const EngineConfig& config)
+	{
+		_engine = std::shared_ptr<__engine_t>(new __engine_t, [](__engine_t *engine) {
+			engine->Stop();
+			delete engine;
+		});
+		_engine->config_ = config;
+	}
+
+	Engine::~Engine() {}
+
+	Engine& Engine::Default()
+	{
+		// dns and tls sessions are shared between the loops,
+		// connections stay in the connection cache of each loop
+		static Share share(false);
+		static Engine engine;
+		static bool attached = (engine.SetShare(&share), true);
+		(void)attached;
+		return engine;
+	}
+
+	bool Engine::Configure(const EngineConfig& config)
+	{
+		std::lock_guard<std::mutex> lock(_engine->mutex_);
+		if (_engine->started_)
+		{
+			return false;
+		}
+		_engine->config_ = config;
+		return true;
+	}
+
+	void Engine::SetShare(Share* share)
+	{
+		std::lock_guard<std::mutex> lock(_engine->mutex_);
+		_engine->share_ = share;
+	}
+
+	size_t Engine::InFlightCount()
+	{
+		return _engine->in_flight_.load();
+	}
+
+	EngineStats Engine::Stats()
+	{
+		EngineStats stats;
+		stats.in_flight_ = _engine->in_flight_.load();
+		stats.submitted_ = _engine->submitted_.load(std::memory_order_relaxed);
+		stats.completed_ = _engine->completed_.load(std::memory_order_relaxed);
+		stats.stolen_ = _engine->stolen_.load(std::memory_order_relaxed);
+		stats.queued_ = _engine->queued_.load();
+		stats.queued_peak_ = _engine->queued_peak_.load();
+		stats.dequeued_ = _engine->dequeued_.load(std::memory_order_relaxed);
+		stats.queue_wait_ns_ = _engine->queue_wait_ns_.load(std::memory_order_relaxed);
+		stats.blocked_ = _engine->blocked_.load(std::memory_order_relaxed);
+		stats.block_wait_ns_ = _engine->block_wait_ns_.load(std::memory_order_relaxed);
+		stats.rejected_ = _engine->rejected_.load(std::memory_order_relaxed);
+		stats.dropped_ = _engine->dropped_.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < HTTP_PRIORITY_COUNT; ++i)
+		{
+			auto& cls = _engine->classes_[i];
+			stats.priorities_[i].queued_ = cls.queued_.load();
+			stats.priorities_[i].dequeued_ = cls.dequeued_.load(std::memory_order_relaxed);
+			stats.priorities_[i].queue_wait_ns_ = cls.queue_wait_ns_.load(std::memory_order_relaxed);
+			stats.priorities_[i].queue_wait_max_ns_ = cls.queue_wait_max_ns_.load(std::memory_order_relaxed);
+		}
+		stats.transferred_ = _engine->transferred_.load(std::memory_order_relaxed);
+		stats.transfer_ns_ = _engine->transfer_ns_.load(std::memory_order_relaxed);
+		stats.delivered_ = _engine->delivered_.load(std::memory_order_relaxed);
+		stats.delivery_wait_ns_ = _engine->delivery_wait_ns_.load(std::memory_order_relaxed);
+		stats.callback_ns_ = _engine->callback_ns_.load(std::memory_order_relaxed);
+		stats.callback_max_ns_ = _engine->callback_max_ns_.load(std::memory_order_relaxed);
+		stats.batches_ = _engine->batches_.load(std::memory_order_relaxed);
+		stats.connections_ = 0;
+		stats.streams_ = 0;
+		{
+			std::lock_guard<std::mutex> lock(_engine->mutex_);
+			std::unordered_map<std::string, size_t> index;
+			for (auto& loop : _engine->loops_)
+			{
+				stats.streams_ += loop->running_count_.load();
+
+				std::lock_guard<std::mutex> usage_lock(loop->usage_mutex_);
+				for (auto& itr : loop->usage_)
+				{
+					// stolen transfers run an origin on more than one loop
+					auto pos = index.emplace(itr.first, stats.origins_.size());
+					if (pos.second)
+					{
+						OriginStats origin;
+						origin.origin_ = itr.first;
+						origin.connections_ = 0;
+						origin.streams_ = 0;
+						stats.origins_.push_back(HTTP_MOVE(origin));
+					}
+					auto& origin = stats.origins_[pos.first->second];
+					origin.connections_ += itr.second.connections_;
+					origin.streams_ += itr.second.streams_;
+					stats.connections_ += itr.second.connections_;
+				}
+			}
+		}
+		stats.connects_ = _engine->connects_.load(std::memory_order_relaxed);
+		stats.multiplexed_ = _engine->multiplexed_.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	std::future<void> Engine::__submit(std::unique_ptr<Session> session, Method method, std::function<void(Response)> complete)
+	{
+		std::unique_ptr<std::promise<void>> promise(new std::promise<void>());
+		auto future = promise->get_future();
+		__enqueue(HTTP_MOVE(session), method, HTTP_MOVE(complete), HTTP_MOVE(promise));
+		return future;
+	}
+
+	Future<Response> Engine::__request(std::unique_ptr<Session> session, Method method)
+	{
+		auto state = std::make_shared<__future_state_t<Response>>();
+		__enqueue(HTTP_MOVE(session), method, [state](Response resp) {
+			state->SetValue(HTTP_MOVE(resp));
+		}, nullptr);
+		return Future<Response>(state);
+	}
+
+	void Engine::__enqueue(std::unique_ptr<Session> session, Method method, std::function<void(Response)> complete, std::unique_ptr<std::promise<void>> promise)
+	{
+		auto transfer = new __transfer_t();
+		transfer->session_ = HTTP_MOVE(session);
+		transfer->complete_ = HTTP_MOVE(complete);
+		transfer->promise_ = HTTP_MOVE(promise);
+		transfer->origin_ = priv::util::__url_origin(transfer->session_->_url.value_);
+		transfer->priority_ = transfer->session_->_priority;
+		transfer->deadline_timer_.data_ = transfer;
+
+		transfer->session_->__set_method(method);
+		_engine->in_flight_.fetch_add(1);
+		_engine->submitted_.fetch_add(1, std::memory_order_relaxed);
+
+		{
+			std::lock_guard<std::mutex> lock(_engine->mutex_);
+			if (_engine->share_)
+			{
+				transfer->session_->SetOption(*_engine->share_);
+			}
+			_engine->Start();
+		}
+
+		ErrorCode code;
+		if (transfer->session_->__stopped(code))
+		{
+			_engine->Fail(transfer, code, priv::util::__stop_reason(code));
+			return;
+		}
+
+		if (!_engine->Reserve(transfer))
+		{
+			return;
+		}
+
+		if (transfer->session_->_cancel)
+		{
+			transfer->cancel_id_ = transfer->session_->_cancel->Subscribe([transfer] {
+				auto loop = transfer->loop_.load();
+				if (loop)
+				{
+					loop->Cancel(transfer->seq_);
+				}
+			});
+
+			if (!transfer->cancel_id_)
+			{
+				_engine->Release(transfer);
+				_engine->Fail(transfer, ErrorCode::cancelled, "request cancelled");
+				return;
+			}
+		}
+		_engine->Submit(transfer);
+	}
+
+	// ----------------------------------------------------------------------------------
+	//
+	//    Batch
+	//
+	// ----------------------------------------------------------------------------------
+
+	// waiting items grouped by origin, origins take turns and each one has an in flight cap
+	template <typename T>
+	struct __origin_queue_t
+	{
+		struct origin_t
+		{
+			std::deque<T> waiting_;
+			size_t in_flight_ = 0;
+			bool active_ = false;
+		};
+
+		size_t max_per_origin_;
+		size_t waiting_ = 0;
+		std::unordered_map<std::string, origin_t> origins_;
+		// origins with waiting items, served round-robin
+		std::deque<origin_t*> active_;
+
+		explicit __origin_queue_t(size_t max_per_origin) : max_per_origin_((std::max)(max_per_origin, (size_t)1)) {}
+
+		void Push(const std::string& origin, T item) {
+			auto& entry = origins_[origin];
+			entry.waiting_.push_back(HTTP_MOVE(item));
+			++waiting_;
+			if (!entry.active_)
+			{
+				entry.active_ = true;
+				active_.push_back(&entry);
+			}
+		};
+
+		// next item of the next origin under its cap, the origin is returned for Done()
+		bool Pop(T& item, origin_t*& origin) {
+			for (size_t i = 0, n = active_.size(); i < n; ++i)
+			{
+				auto entry = active_.front();
+				active_.pop_front();
+
+				if (entry->in_flight_ >= max_per_origin_)
+				{
+					active_.push_back(entry);
+					continue;
+				}
+
+				item = HTTP_MOVE(entry->waiting_.front());
+				entry->waiting_.pop_front();
+				--waiting_;
+				++entry->in_flight_;
+
+				if (entry->waiting_.empty())
+				{
+					entry->active_ = false;
+				}
+				else
+				{
+					active_.push_back(entry);
+				}
+
+				origin = entry;
+				return true;
+			}
+			return false;
+		};
+
+		void Done(origin_t* origin) {
+			--origin->in_flight_;
+		};
+	};
+
+	Batch::Batch(size_t max_in_flight, size_t max_per_host)
+		: _max_in_flight((std::max)(max_in_flight, (size_t)1)), _max_per_host(max_per_host) {}
+
+	size_t Batch::Size()
+	{
+		return _requests.size();
+	}
+
+	std::vector<Response> Batch::Run()
+	{
+		std::vector<Response> responses(_requests.size());
+		Run([&responses](size_t index, Response resp) {
+			responses[index] = HTTP_MOVE(resp);
+		});
+		return responses;
+	}
+
+	void Batch::Run(std::function<void(size_t index, Response resp)> complete)
+	{
+		using queue_t = __origin_queue_t<size_t>;
+
+		struct slot_t
+		{
+			std::unique_ptr<Session> session_;
+			size_t index_;
+			queue_t::origin_t *origin_;
+		};
+
+		auto requests = HTTP_MOVE(_requests);
+		_requests.clear();
+
+		queue_t queue(_max_per_host);
+		for (size_t i = 0; i < requests.size(); ++i)
+		{
+			queue.Push(priv::util::__url_origin(requests[i].url_), i);
+		}
+
+		// declared first, so the sessions are cleaned up before the multi handle
+		std::unique_ptr<CURLM, CURLMcode(*)(CURLM *)> multi_ptr(curl_multi_init(), &curl_multi_cleanup);
+		auto multi = multi_ptr.get();
+
+		std::vector<slot_t> slots(_max_in_flight);
+		// finished sessions are reset and reused, the handles stay warm
+		std::vector<slot_t*> free_slots;
+		for (auto& slot : slots)
+		{
+			free_slots.push_back(&slot);
+		}
+
+		size_t running = 0;
+		size_t left = requests.size();
+		// running with a cancel token
+		size_t cancellable = 0;
+
+		while (left > 0)
+		{
+			// fill the free slots
+			while (!free_slots.empty())
+			{
+				size_t index;
+				queue_t::origin_t *origin;
+				if (!queue.Pop(index, origin))
+				{
+					break;
+				}
+
+				auto slot = free_slots.back();
+				free_slots.pop_back();
+
+				if (slot->session_)
+				{
+					slot->session_->Reset();
+				}
+				else
+				{
+					slot->session_.reset(new Session());
+				}
+				slot->index_ = index;
+				slot->origin_ = origin;
+
+				auto& request = requests[index];
+				request.options_(*slot->session_);
+				// the options are not needed anymore
+				request.options_ = nullptr;
+				request.url_.clear();
+
+				// cancelled or expired while it waited for its turn
+				ErrorCode code;
+				if (slot->session_->__stopped(code))
+				{
+					--left;
+					queue.Done(origin);
+					free_slots.push_back(slot);
+					complete(index, priv::util::__error_response(code, priv::util::__stop_reason(code)));
+					continue;
+				}
+
+				auto curl = slot->session_->_curl_handle_ptr->curl_;
+				slot->session_->__set_method(request.method_);
+				slot->session_->__prepare(curl);
+				slot->session_->__set_timeout(curl);
+				curl_easy_setopt(curl, CURLOPT_PRIVATE, slot);
+				if (curl_multi_add_handle(multi, curl) != CURLM_OK)
+				{
+					--left;
+					queue.Done(origin);
+					free_slots.push_back(slot);
+					complete(index, priv::util::__error_response(ErrorCode::curl, "curl_multi_add_handle failed"));
+					continue;
+				}
+				++running;
+				if (slot->session_->_cancel)
+				{
+					++cancellable;
+				}
+			}
+
+			int still_running = 0;
+			curl_multi_perform(multi, &still_running);
+
+			CURLMsg *msg = nullptr;
+			int msgs_left = 0;
+			while ((msg = curl_multi_info_read(multi, &msgs_left)))
+			{
+				if (msg->msg != CURLMSG_DONE)
+				{
+					continue;
+				}
+
+				auto curl = msg->easy_handle;
+				auto res = msg->data.result;
+				slot_t *slot = nullptr;
+				curl_easy_getinfo(curl, CURLINFO_PRIVATE, &slot);
+				curl_multi_remove_handle(multi, curl);
+
+				--running;
+				--left;
+				queue.Done(slot->origin_);
+				free_slots.push_back(slot);
+				if (slot->session_->_cancel)
+				{
+					--cancellable;
+				}
+
+				complete(slot->index_, slot->session_->__response(curl, res));
+			}
+
+			if (running > 0)
+			{
+				// the progress callback only sees a cancelled token while curl runs,
+				// a deadline is a curl timer and ends the wait by itself
+				curl_multi_wait(multi, nullptr, 0, cancellable ? 50 : 1000, nullptr);
+			}
+		}
+
+		// sessions must go before the multi handle
+		slots.clear();
+	}
+
+	// ----------------------------------------------------------------------------------
+	//
+	//    Reactor
+	//
+	// ----------------------------------------------------------------------------------
+
+	struct __reactor_t
+	{
+		struct transfer_t
+		{
+			std::unique_ptr<Session> session_;
+			std::function<void(Response)> complete_;
+
+			// subscribed to the cancel token
+			uint64_t seq_ = 0;
+			uint64_t cancel_id_ = 0;
+
+			// on the multi handle
+			transfer_t *prev_ = nullptr;
+			transfer_t *next_ = nullptr;
+		};
+
+		CURLM *multi_ = nullptr;
+		ReactorHooks hooks_;
+		Share *share_ = nullptr;
+
+		transfer_t *running_ = nullptr;
+		size_t in_flight_ = 0;
+		bool stop_ = false;
+
+		// running transfers with a cancel token by seq, the loop thread only
+		uint64_t next_seq_ = 0;
+		std::unordered_map<uint64_t, transfer_t*> cancellable_;
+
+		// seqs of cancelled tokens, filled on any thread
+		std::mutex mutex_;
+		std::vector<uint64_t> cancelled_;
+
+		void Add(transfer_t* transfer) {
+			auto curl = transfer->session_->_curl_handle_ptr->curl_;
+			transfer->session_->__prepare(curl);
+			transfer->session_->__set_timeout(curl);
+			curl_easy_setopt(curl, CURLOPT_PRIVATE, transfer);
+
+			// curl asks for a timer to start the transfer from the loop
+			if (curl_multi_add_handle(multi_, curl) != CURLM_OK)
+			{
+				Fail(transfer, ErrorCode::curl, "curl_multi_add_handle failed");
+				return;
+			}
+
+			transfer->next_ = running_;
+			if (running_)
+			{
+				running_->prev_ = transfer;
+			}
+			running_ = transfer;
+		};
+
+		void Remove(transfer_t* transfer) {
+			curl_multi_remove_handle(multi_, transfer->session_->_curl_handle_ptr->curl_);
+
+			if (transfer->prev_)
+			{
+				transfer->prev_->next_ = transfer->next_;
+			}
+			else
+			{
+				running_ = transfer->next_;
+			}
+			if (transfer->next_)
+			{
+				transfer->next_->prev_ = transfer->prev_;
+			}
+			transfer->prev_ = transfer->next_ = nullptr;
+		};
+
+		void Finish(transfer_t* transfer, Response resp) {
+			std::unique_ptr<transfer_t> owner(transfer);
+			// waits for a cancellation running on another thread
+			if (transfer->cancel_id_)
+			{
+				transfer->session_->_cancel->Unsubscribe(transfer->cancel_id_);
+				cancellable_.erase(transfer->seq_);
+			}
+			--in_flight_;
+			if (transfer->complete_)
+			{
+				transfer->complete_(HTTP_MOVE(resp));
+			}
+		};
+
+		void Fail(transfer_t* transfer, ErrorCode code, const char* reason) {
+			Finish(transfer, priv::util::__error_response(code, reason));
+		};
+
+		// from the cancel token, the transfer is looked up again on the loop thread
+		void Cancel(uint64_t seq) {
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				cancelled_.push_back(seq);
+			}
+			if (hooks_.wakeup_)
+			{
+				hooks_.wakeup_();
+			}
+		};
+
+		// a stalled transfer makes no progress calls, it is taken off the multi handle here
+		void Stop() {
+			std::vector<uint64_t> cancelled;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				cancelled.swap(cancelled_);
+			}
+
+			for (auto seq : cancelled)
+			{
+				// completed meanwhile
+				auto itr = cancellable_.find(seq);
+				if (itr != cancellable_.end())
+				{
+					auto transfer = itr->second;
+					Remove(transfer);
+					Fail(transfer, ErrorCode::cancelled, "request cancelled");
+				}
+			}
+		};
+
+		void Action(curl_socket_t socket, int flags) {
+			Stop();
+
+			int still_running = 0;
+			curl_multi_socket_action(multi_, socket, flags, &still_running);
+			Complete();
+		};
+
+		void Complete() {
+			CURLMsg *msg = nullptr;
+			int left = 0;
+			while ((msg = curl_multi_info_read(multi_, &left)))
+			{
+				if (msg->msg != CURLMSG_DONE)
+				{
+					continue;
+				}
+
+				auto curl = msg->easy_handle;
+				auto res = msg->data.result;
+				transfer_t *transfer = nullptr;
+				curl_easy_getinfo(curl, CURLINFO_PRIVATE, &transfer);
+				Remove(transfer);
+
+				Finish(transfer, transfer->session_->__response(curl, res));
+			}
+		};
+
+		static int __socket_function(CURL *, curl_socket_t socket, int what, void *userp, void *) {
+			auto reactor = (__reactor_t *)userp;
+
+			int events = Reactor::none;
+			if (what != CURL_POLL_REMOVE)
+			{
+				events = ((what & CURL_POLL_IN) ? Reactor::read : 0) | ((what & CURL_POLL_OUT) ? Reactor::write : 0);
+			}
+			if (reactor->hooks_.watch_)
+			{
+				reactor->hooks_.watch_(socket, events);
+			}
+			return 0;
+		};
+
+		static int __timer_function(CURLM *, long timeout_ms, void *userp) {
+			auto reactor = (__reactor_t *)userp;
+
+			if (reactor->hooks_.timer_)
+			{
+				reactor->hooks_.timer_(timeout_ms);
+			}
+			return 0;
+		};
+	};
+
+	Reactor::Reactor(ReactorHooks hooks)
+	{
+		_reactor = std::shared_ptr<__reactor_t>(new __reactor_t, [](__reactor_t *reactor) {
+			// completions may submit again, they fail at once
+			reactor->stop_ = true;
+			while (reactor->running_)
+			{
+				auto transfer = reactor->running_;
+				reactor->Remove(transfer);
+				reactor->Fail(transfer, ErrorCode::aborted, "reactor stopped");
+			}
+			curl_multi_cleanup(reactor->multi_);
+			delete reactor;
+		});
+		_reactor->hooks_ = HTTP_MOVE(hooks);
+		_reactor->multi_ = curl_multi_init();
+
+		curl_multi_setopt(_reactor->multi_, CURLMOPT_SOCKETFUNCTION, &__reactor_t::__socket_function);
+		curl_multi_setopt(_reactor->multi_, CURLMOPT_SOCKETDATA, _reactor.get());
+		curl_multi_setopt(_reactor->multi_, CURLMOPT_TIMERFUNCTION, &__reactor_t::__timer_function);
+		curl_multi_setopt(_reactor->multi_, CURLMOPT_TIMERDATA, _reactor.get());
+	}
+
+	Reactor::~Reactor() {}
+
+	void Reactor::SetShare(Share* share)
+	{
+		_reactor->share_ = share;
+	}
+
+	void Reactor::OnSocketReady(curl_socket_t socket, int events)
+	{
+		int flags = 0;
+		if (events & read) flags |= CURL_CSELECT_IN;
+		if (events & write) flags |= CURL_CSELECT_OUT;
+		if (events & error) flags |= CURL_CSELECT_ERR;
+		_reactor->Action(socket, flags);
+	}
+
+	void Reactor::OnTimeout()
+	{
+		_reactor->Action(CURL_SOCKET_TIMEOUT, 0);
+	}
+
+	size_t Reactor::InFlightCount()
+	{
+		return _reactor->in_flight_;
+	}
+
+	void Reactor::__submit(std::unique_ptr<Session> session, Method method, std::function<void(Response)> complete)
+	{
+		auto transfer = new __reactor_t::transfer_t();
+		transfer->session_ = HTTP_MOVE(session);
+		transfer->complete_ = HTTP_MOVE(complete);
+		transfer->session_->__set_method(method);
+
+		if (_reactor->share_)
+		{
+			transfer->session_->SetOption(*_reactor->share_);
+		}
+
+		++_reactor->in_flight_;
+
+		if (_reactor->stop_)
+		{
+			_reactor->Fail(transfer, ErrorCode::aborted, "reactor stopped");
+			return;
+		}
+
+		ErrorCode code;
+		if (transfer->session_->__stopped(code))
+		{
+			_reactor->Fail(transfer, code, priv::util::__stop_reason(code));
+			return;
+		}
+
+		if (transfer->session_->_cancel)
+		{
+			auto reactor = _reactor.get();
+			auto seq = ++reactor->next_seq_;
+			transfer->cancel_id_ = transfer->session_->_cancel->Subscribe([reactor, seq] {
+				reactor->Cancel(seq);
+			});
+
+			// cancelled since the check
+			if (!transfer->cancel_id_)
+			{
+				_reactor->Fail(transfer, ErrorCode::cancelled, "request cancelled");
+				return;
+			}
+			transfer->seq_ = seq;
+			_reactor->cancellable_[seq] = transfer;
+		}
+		_reactor->Add(transfer);
+	}
+
+	// ----------------------------------------------------------------------------------
+	//
+	//    private util
+	//
+	// ----------------------------------------------------------------------------------
+
+	std::string priv::util::__url_encode(const std::string& value_to_escape)
+	{
+		std::string escaped;
+		char *escape_control = curl_easy_escape(nullptr, value_to_escape.c_str(), value_to_escape.size());
+		escaped = escape_control;
+		curl_free(escape_control);
+		return escaped;
+	}
+
+	std::string priv::util::__url_origin(const std::string& url)
+	{
+		// scheme://host:port, the key connections are reused by
+		auto begin = url.find("://");
+		begin = begin == std::string::npos ? 0 : begin + 3;
+		auto end = url.find_first_of("/?#", begin);
+
+		auto origin = url.substr(0, end);
+		std::transform(origin.begin(), origin.end(), origin.begin(), ::tolower);
+		return origin;
+	}
+
+	Response priv::util::__error_response(ErrorCode code, const char* reason)
+	{
+		Response resp(-1, "", Headers(), reason);
+		resp.error_code_ = code;
+		return resp;
+	}
+
+	const char* priv::util::__stop_reason(ErrorCode code)
+	{
+		return code == ErrorCode::cancelled ? "request cancelled" : "deadline passed";
+	}
+
+	bool priv::util::__starts_with_icase(const char* data, size_t size, const char* prefix)
+	{
+		size_t i = 0;
+		for (; prefix[i]; ++i)
+		{
+			if (i >= size || ::tolower((unsigned char)data[i]) != ::tolower((unsigned char)prefix[i]))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+
+	// ----------------------------------------------------------------------------------
+	//
+	//    Headers 
+	//
+	// ----------------------------------------------------------------------------------
+
+	Headers::Headers(std::string&& header_string)
+	{
+		__parse_http_header(header_string);
+	}
+
+	Headers::Headers(std::string& header_string)
+	{
+		__parse_http_header(header_string);
+	}
+
+	Headers::Headers(const std::initializer_list<Field>& headers)
+	{
+		for (const auto& header : headers)
+		{
+			_storage_headers[__string_t(header.key_.data(), header.key_.size())].assign(header.value_.data(), header.value_.size());
+		}
+	}
+
+	Headers::Headers(std::unordered_map<std::string, std::string>& map)
+	{
+		for (const auto& pair : map)
+		{
+			_storage_headers[__string_t(pair.first.data(), pair.first.size())].assign(pair.second.data(), pair.second.size());
+		}
+	}
+
+#ifdef HTTP_HAS_PMR
+	Headers::Headers(std::string& header_string, std::pmr::memory_resource* arena)
+		: _storage_headers(arena)
+	{
+		__parse_http_header(header_string);
+	}
+#endif
+
+	curl_slist* Headers::Chunk()
+	{
+		struct curl_slist* chunk = nullptr;
+		for (auto itr = _storage_headers.cbegin(); itr != _storage_headers.cend(); ++itr) 
+		{
+			auto header_string = std::string(itr->first.data(), itr->first.size());
+			if (itr->second.empty()) 
+			{
+				header_string += ";";
+			}
+			else 
+			{
+				header_string.append(": ").append(itr->second.data(), itr->second.size());
+			}
+			chunk = curl_slist_append(chunk, header_string.data());
+		}
+		return chunk;
+	}
+
+	Headers& Headers::Merge(Headers& other)
+	{
+		for (const auto& pair : other._storage_headers)
+		{
+			_storage_headers.insert(pair);
+		}
+		return *this;
+	}
+
+	// the fields are built in place with the allocator of the map, no line by line copies
+	void Headers::__parse_http_header(std::string& header_string)
+	{
+		__string_t::allocator_type allocator(_storage_headers.get_allocator());
+
+		size_t begin = 0;
+		while (begin < header_string.size())
+		{
+			auto end = header_string.find('\n', begin);
+			if (end == std::string::npos)
+			{
+				end = header_string.size();
+			}
+
+			auto colon = static_cast<const char*>(memchr(header_string.data() + begin, ':', end - begin));
+			if (colon)
+			{
+				size_t found = colon - header_string.data();
+
+				// erase space
+				auto value_begin = found + 1;
+				while (value_begin < end && (header_string[value_begin] == '\t' || header_string[value_begin] == ' '))
+				{
+					++value_begin;
+				}
+				auto value_end = end;
+				while (value_end > value_begin && (header_string[value_end - 1] == '\t' || header_string[value_end - 1] == '\r' || header_string[value_end - 1] == ' '))
+				{
+					--value_end;
+				}
+
+				__string_t key(header_string.data() + begin, found - begin, allocator);
+				_storage_headers[HTTP_MOVE(key)].assign(header_string.data() + value_begin, value_end - value_begin);
+			}
+
+			begin = end + 1;
+		}
+	}
+
+
+	// ----------------------------------------------------------------------------------
+	//
+	//    Response 
+	//
+	// ----------------------------------------------------------------------------------
+
+	Response::Response(int&& code, std::string&& body, Headers&& headers, std::string&& error)
+		: code_(code), body_(HTTP_MOVE(body)), headers_(HTTP_MOVE(headers)), error_(HTTP_MOVE(error)) {}
+
+	BufferStats GetBufferStats()
+	{
+		BufferStats stats;
+		stats.presized_ = __buffer_stats.presized_.load(std::memory_order_relaxed);
+		stats.preallocated_files_ = __buffer_stats.preallocated_files_.load(std::memory_order_relaxed);
+		stats.reallocations_ = __buffer_stats.reallocations_.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	// ----------------------------------------------------------------------------------
+	//
+	//    BodySink
+	//
+	// ----------------------------------------------------------------------------------
+
+	BodySink BodySink::Memory()
+	{
+		return BodySink();
+	}
+
+	BodySink BodySink::File(std::string path)
+	{
+		BodySink sink;
+		sink._kind = file;
+		sink._path = HTTP_MOVE(path);
+		return sink;
+	}
+
+	BodySink BodySink::Buffer(char* data, size_t capacity, Overflow overflow)
+	{
+		BodySink sink;
+		sink._kind = buffer;
+		sink._data = data;
+		sink._capacity = data ? capacity : 0;
+		sink._overflow = overflow;
+		return sink;
+	}
+
+	BodySink BodySink::Discard()
+	{
+		BodySink sink;
+		sink._kind = discard;
+		return sink;
+	}
+
+	BodySink BodySink::Tee(BodySink first, BodySink second)
+	{
+		BodySink sink;
+		sink._kind = tee;
+		sink._first = std::make_shared<const BodySink>(HTTP_MOVE(first));
+		sink._second = std::make_shared<const BodySink>(HTTP_MOVE(second));
+		return sink;
+	}
+
+	BodySink BodySink::Custom(std::shared_ptr<BodyWriter> writer)
+	{
+		BodySink sink;
+		if (writer)
+		{
+			sink._kind = custom;
+			sink._writer = HTTP_MOVE(writer);
+		}
+		else
+		{
+			sink._kind = discard;
+		}
+		return sink;
+	}
+
+
+	// ----------------------------------------------------------------------------------
+	//
+	//    BufferPool
+	//
+	// ----------------------------------------------------------------------------------
+
+	void SetBufferPool(const BufferPoolConfig& config)
+	{
+		__buffer_pool.thread_cache_.store(config.thread_cache_buffers_, std::memory_order_relaxed);
+		__buffer_pool.max_retained_.store(config.max_retained_bytes_, std::memory_order_relaxed);
+
+		if (config.max_retained_bytes_ == 0)
+		{
+			__buffer_cache.Clear();
+
+			std::lock_guard<std::mutex> lock(__buffer_pool.mutex_);
+			for (auto& buffers : __buffer_pool.shared_)
+			{
+				for (auto& buffer : buffers)
+				{
+					__buffer_pool.retained_.fetch_sub(buffer.capacity(), std::memory_order_relaxed);
+				}
+				buffers.clear();
+			}
+		}
+	}
+
+	BufferPoolStats GetBufferPoolStats()
+	{
+		BufferPoolStats stats;
+		stats.hits_ = __buffer_pool.hits_.load(std::memory_order_relaxed);
+		stats.misses_ = __buffer_pool.misses_.load(std::memory_order_relaxed);
+		stats.recycled_ = __buffer_pool.recycled_.load(std::memory_order_relaxed);
+		stats.dropped_ = __buffer_pool.dropped_.load(std::memory_order_relaxed);
+		stats.retained_bytes_ = __buffer_pool.retained_.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	void Recycle(Response&& resp)
+	{
+		Recycle(HTTP_MOVE(resp.body_));
+	}
+
+	void Recycle(std::string&& body)
+	{
+		std::string buffer(HTTP_MOVE(body));
+		body.clear();
+		__buffer_release(HTTP_MOVE(buffer));
+	}
 
 
 	// ----------------------------------------------------------------------------------
@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+
+#include <http/http.h>
+
+#include "local.h"
+
+
+
+TEST(BatchTests, OrderTest)
+{
+	http::Batch batch(4, 2);
+
+	for (int i = 0; i < 10; ++i)
+	{
+		batch.Add(http::Method::get, http::URL{ "www.baidu.com" }, http::Parameters{ { "index", i } });
+	}
+	batch.Add(http::Method::head, http::URL{ "www.qq.com" });
+
+	EXPECT_EQ(11u, batch.Size());
+
+	auto responses = batch.Run();
+
+	EXPECT_EQ(11u, responses.size());
+	// the batch is consumed
+	EXPECT_EQ(0u, batch.Size());
+
+}
+
+TEST(BatchTests, StreamTest)
+{
+	http::Batch batch;
+	http::Share share;
+
+	for (int i = 0; i < 10; ++i)
+	{
+		batch.Add(http::Method::get, http::URL{ "www.baidu.com" }, std::ref(share));
+	}
+
+	std::vector<bool> seen(10, false);
+	batch.Run([&seen](size_t index, http::Response resp) {
+		seen[index] = true;
+	});
+
+	EXPECT_EQ(10, std::count(seen.begin(), seen.end(), true));
+
+}
+
+TEST(BatchTests, GetManyTest)
+{
+	auto responses = http::GetMany(
+		{ "www.baidu.com", "www.qq.com", "www.example.com" },
+		http::Headers{ { "Accept", "*/*" } }
+	);
+
+	EXPECT_EQ(3u, responses.size());
+
+}
+
+TEST(BatchTests, StopTest)
+{
+	LocalServer server;
+	http::Batch batch;
+
+	auto start = std::chrono::steady_clock::now();
+	http::CancelToken token;
+	http::CancelToken cancelled;
+	cancelled.Cancel();
+
+	batch.Add(http::Method::get, http::URL{ server.URL("/sleep/2000") }, http::Deadline{ start + std::chrono::milliseconds(200) });
+	batch.Add(http::Method::get, http::URL{ server.URL("/sleep/2000") }, token);
+	batch.Add(http::Method::get, http::URL{ server.URL("/sleep/2000") }, cancelled);
+	batch.Add(http::Method::get, http::URL{ server.URL("/bytes/10") }, http::Deadline{ start + std::chrono::seconds(10) });
+
+	std::thread canceller([&token] {
+		std::this_thread::sleep_for(std::chrono::milliseconds(300));
+		token.Cancel();
+	});
+	auto responses = batch.Run();
+	canceller.join();
+
+	EXPECT_EQ(http::ErrorCode::deadline, responses[0].error_code_);
+	EXPECT_EQ(http::ErrorCode::cancelled, responses[1].error_code_);
+	EXPECT_EQ(http::ErrorCode::cancelled, responses[2].error_code_);
+	EXPECT_EQ(http::ErrorCode::none, responses[3].error_code_);
+
+	// neither waited for the 2s responses
+	auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	EXPECT_GT(1000, elapsed_ms);
+
+}
@@ -0,0 +1,351 @@
+#include <gtest/gtest.h>
+
+#include <http/http.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+#ifdef HTTP_HAS_PMR
+#include <memory_resource>
+#endif
+#include <thread>
+
+#include "../local.h"
+
+// A binary of its own, the counting operator new below must not reach the other tests.
+// Benchmarks are disabled by default, run them with
+//   --gtest_also_run_disabled_tests --gtest_filter=BenchmarkTests.*
+// against a local keep-alive server given by HTTP_BENCH_URL (http://127.0.0.1:8080/ by default).
+// High concurrency needs a raised descriptor limit (ulimit -n).
+// ResponseBodyCopies, ResponseBodyBuffer and ArenaAllocations (HTTP_USE_PMR builds) read a local file and always run.
+
+// allocations of at least g_large_size bytes, counted while it is set
+static std::atomic<size_t> g_large_size{ 0 };
+static std::atomic<size_t> g_large_count{ 0 };
+
+void* operator new(size_t size)
+{
+	auto large = g_large_size.load(std::memory_order_relaxed);
+	if (large && size >= large)
+	{
+		g_large_count.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	auto ptr = std::malloc(size ? size : 1);
+	if (!ptr)
+	{
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	std::free(ptr);
+}
+
+// allocations of at least large bytes made by count requests, and the nanoseconds they took
+static size_t CountLarge(size_t large, int count, const std::function<void()>& request, long long& ns)
+{
+	g_large_count.store(0);
+	g_large_size.store(large);
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; ++i)
+	{
+		request();
+	}
+	ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	g_large_size.store(0);
+	return g_large_count.load();
+}
+
+static std::string BenchURL()
+{
+	auto url = std::getenv("HTTP_BENCH_URL");
+	return url ? url : "http://127.0.0.1:8080/";
+}
+
+static const char* BackendName(http::EngineBackend backend)
+{
+	return backend == http::EngineBackend::epoll ? "epoll" : "poll";
+}
+
+// cpu time per request as concurrency grows
+TEST(BenchmarkTests, DISABLED_EngineBackend)
+{
+	auto url = BenchURL();
+
+	for (auto backend : { http::EngineBackend::poll, http::EngineBackend::epoll })
+	{
+		for (int concurrency : { 100, 1000, 10000, 50000 })
+		{
+			http::EngineConfig config;
+			config.backend_ = backend;
+			http::Engine engine(config);
+
+			std::atomic<int> ok{ 0 };
+			std::vector<std::future<void>> futures;
+			futures.reserve(concurrency);
+
+			auto cpu_start = std::clock();
+			auto wall_start = std::chrono::steady_clock::now();
+
+			for (int i = 0; i < concurrency; ++i)
+			{
+				futures.push_back(engine.Submit(http::Method::get, [&ok](http::Response resp) {
+					if (resp.code_ == HTTP_OK) ++ok;
+				}, http::URL{ url }));
+			}
+
+			for (auto& future : futures)
+			{
+				future.get();
+			}
+
+			auto cpu_us = (std::clock() - cpu_start) * 1e6 / CLOCKS_PER_SEC;
+			auto wall_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - wall_start).count();
+
+			std::cout << BackendName(backend) << " concurrency " << concurrency
+				<< " ok " << ok.load()
+				<< " wall " << wall_ms << " ms"
+				<< " cpu " << cpu_us / concurrency << " us/request" << std::endl;
+		}
+	}
+
+}
+
+// deadline timers of 100k queued requests, the loop runs one transfer at a time so the rest wait with their timer armed
+TEST(BenchmarkTests, DISABLED_DeadlineTimers)
+{
+	auto url = BenchURL();
+	const int count = 100000;
+
+	for (bool deadlines : { false, true })
+	{
+		http::EngineConfig config;
+		config.max_transfers_ = 1;
+		http::Engine engine(config);
+
+		http::CancelToken token;
+		std::vector<http::Future<http::Response>> futures;
+		futures.reserve(count);
+
+		auto now = std::chrono::steady_clock::now();
+		auto submit_start = std::chrono::steady_clock::now();
+
+		for (int i = 0; i < count; ++i)
+		{
+			// spread over a minute, every level of the wheel gets some
+			auto deadline = deadlines ? now + std::chrono::seconds(60) + std::chrono::milliseconds(i % 60000) : std::chrono::steady_clock::time_point();
+			futures.push_back(engine.Request(http::Method::get, http::URL{ url }, token, http::Deadline{ deadline }));
+		}
+
+		auto submit_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - submit_start).count();
+
+		// the loop keeps waking up for the running transfers while the timers are pending
+		auto cpu_start = std::clock();
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+		auto idle_cpu_ms = (std::clock() - cpu_start) * 1e3 / CLOCKS_PER_SEC;
+
+		auto cancel_start = std::chrono::steady_clock::now();
+		token.Cancel();
+		for (auto& future : futures)
+		{
+			future.Wait();
+		}
+		auto cancel_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - cancel_start).count();
+
+		std::cout << (deadlines ? "with deadlines   " : "without deadlines")
+			<< " submit " << submit_ns / count << " ns/request"
+			<< " cpu over 1s " << idle_cpu_ms << " ms"
+			<< " cancel " << cancel_ns / count << " ns/request"
+			<< " completed before the cancel " << engine.Stats().dequeued_ << std::endl;
+	}
+
+}
+
+// the body buffer grows past the body size once while it is received,
+// any later allocation that big is a copy on the way to the caller
+TEST(BenchmarkTests, ResponseBodyCopies)
+{
+	const size_t size = 8 << 20;
+	const int count = 4;
+
+	LocalFile file("http_body_copies.bin", size);
+	auto url = file.URL();
+
+	http::Engine engine;
+
+	auto run = [&](const char* name, std::function<http::Response()> request) {
+		long long ns;
+		auto allocations = CountLarge(size, count, [&] {
+			auto resp = request();
+			EXPECT_EQ(size, resp.body_.size());
+		}, ns);
+
+		EXPECT_EQ((size_t)count, allocations) << name;
+		std::cout << name << " " << allocations / count << " body allocations per response, "
+			<< size * count * 1e3 / ns << " MB/s" << std::endl;
+	};
+
+	run("sync", [&] {
+		return http::Get(http::URL{ url });
+	});
+	run("future", [&] {
+		return engine.Request(http::Method::get, http::URL{ url }).Get();
+	});
+	run("callback", [&] {
+		http::Response resp;
+		engine.Submit(http::Method::get, [&resp](http::Response r) {
+			resp = HTTP_MOVE(r);
+		}, http::URL{ url }).get();
+		return resp;
+	});
+
+}
+
+// a small body written into the caller's buffer by a reused session,
+// the default sink allocates a string that big for every response
+TEST(BenchmarkTests, ResponseBodyBuffer)
+{
+	const size_t size = 3000;
+	const int count = 1000;
+
+	LocalFile file("http_body_buffer.bin", size);
+	auto url = file.URL();
+
+	char buffer[4096];
+
+	auto run = [&](const char* name, http::BodySink sink, size_t expected) {
+		http::Session session;
+		http::URL option{ url };
+		session.SetOption(option);
+		session.SetOption(sink);
+
+		// the handle warms up first
+		session.Get();
+
+		long long ns;
+		auto allocations = CountLarge(size, count, [&] {
+			auto resp = session.Get();
+			EXPECT_EQ(size, resp.body_size_);
+			EXPECT_FALSE(resp.truncated_);
+		}, ns);
+
+		EXPECT_EQ(expected, allocations) << name;
+		std::cout << name << " " << allocations * 1.0 / count << " body allocations per response, "
+			<< ns / count << " ns/request" << std::endl;
+	};
+
+	run("memory", http::BodySink::Memory(), count);
+	run("buffer", http::BodySink::Buffer(buffer, sizeof(buffer)), 0);
+	EXPECT_EQ(std::string(size, 'x'), std::string(buffer, size));
+
+	// a buffer too small for the body
+	http::Session session;
+	http::URL option{ url };
+	session.SetOption(option);
+	auto small = http::BodySink::Buffer(buffer, 1000);
+	session.SetOption(small);
+	auto resp = session.Get();
+	EXPECT_EQ(http::ErrorCode::none, resp.error_code_);
+	EXPECT_TRUE(resp.truncated_);
+	EXPECT_EQ(size, resp.body_size_);
+
+	auto stop = http::BodySink::Buffer(buffer, 1000, http::BodySink::stop);
+	session.SetOption(stop);
+	resp = session.Get();
+	EXPECT_EQ(http::ErrorCode::stopped, resp.error_code_);
+	EXPECT_TRUE(resp.truncated_);
+
+}
+
+#ifdef HTTP_HAS_PMR
+// pmr allocations that reach the heap, the default resource uses the aligned operator new the counter above leaves out
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+	std::atomic<size_t> count_{ 0 };
+
+private:
+	void* do_allocate(size_t bytes, size_t alignment) override
+	{
+		count_.fetch_add(1, std::memory_order_relaxed);
+		return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+	}
+
+	void do_deallocate(void* ptr, size_t bytes, size_t alignment) override
+	{
+		std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	{
+		return this == &other;
+	}
+};
+
+// every allocation of a reused session, with the default allocator and with an arena released after each response
+TEST(BenchmarkTests, ArenaAllocations)
+{
+	const size_t size = 3000;
+	const int count = 1000;
+
+	LocalFile file("http_arena.bin", size);
+	auto url = file.URL();
+
+	// the body stays out of it
+	char buffer[4096];
+
+	CountingResource heap;
+	auto default_resource = std::pmr::set_default_resource(&heap);
+
+	auto run = [&](const char* name, std::pmr::monotonic_buffer_resource* arena) {
+		http::Session session;
+		http::URL option{ url };
+		session.SetOption(option);
+		auto sink = http::BodySink::Buffer(buffer, sizeof(buffer));
+		session.SetOption(sink);
+		if (arena)
+		{
+			http::Arena arena_option{ arena };
+			session.SetOption(arena_option);
+		}
+
+		// the handle warms up first
+		session.Get();
+
+		heap.count_.store(0);
+		long long ns;
+		auto allocations = CountLarge(1, count, [&] {
+			{
+				auto resp = session.Get();
+				EXPECT_EQ(size, resp.body_size_);
+			}
+			if (arena)
+			{
+				arena->release();
+			}
+		}, ns) + heap.count_.load();
+		std::cout << name << " " << allocations * 1.0 / count << " allocations per request, "
+			<< ns / count << " ns/request" << std::endl;
+		return allocations;
+	};
+
+	char storage[16 * 1024];
+	std::pmr::monotonic_buffer_resource arena(storage, sizeof(storage), &heap);
+
+	auto heap_allocations = run("default", nullptr);
+	auto arena_allocations = run("arena", &arena);
+	EXPECT_LT(arena_allocations, heap_allocations);
+
+	std::pmr::set_default_resource(default_resource);
+
+}
+#endif
@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+
+#include <http/http.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+
+
+// counts the body and stops after limit bytes
+class CountingWriter : public http::BodyWriter
+{
+public:
+	CountingWriter(size_t limit) : limit_(limit) {}
+
+	void Reserve(size_t size) override { reserved_ = size; }
+
+	bool Write(const char* data, size_t size) override
+	{
+		written_ += size;
+		return written_ < limit_;
+	}
+
+public:
+	size_t limit_;
+	size_t reserved_ = 0;
+	size_t written_ = 0;
+};
+
+TEST(BodySinkTests, DiscardTest)
+{
+	auto resp = http::Get(http::URL{ "www.baidu.com" }, http::BodySink::Discard());
+
+	if (resp.error_code_ == http::ErrorCode::none)
+	{
+		EXPECT_TRUE(resp.body_.empty());
+		EXPECT_LT(0u, resp.body_size_);
+	}
+
+}
+
+TEST(BodySinkTests, BufferTest)
+{
+	char buffer[64];
+	auto resp = http::Get(http::URL{ "www.baidu.com" }, http::BodySink::Buffer(buffer, sizeof(buffer)));
+
+	if (resp.error_code_ == http::ErrorCode::none)
+	{
+		EXPECT_TRUE(resp.body_.empty());
+		EXPECT_LT(0u, resp.body_size_);
+
+		// the page starts the same as with the default sink
+		auto full = http::Get(http::URL{ "www.baidu.com" });
+		auto size = (std::min)((size_t)15, resp.body_size_);
+		if (full.error_code_ == http::ErrorCode::none && full.body_.size() >= size)
+		{
+			EXPECT_EQ(full.body_.substr(0, size), std::string(buffer, size));
+		}
+	}
+
+}
+
+TEST(BodySinkTests, TeeTest)
+{
+	const char* path = "body_sink_tee.html";
+	auto resp = http::Get(
+		http::URL{ "www.baidu.com" },
+		http::BodySink::Tee(http::BodySink::Memory(), http::BodySink::File(path))
+	);
+
+	if (resp.error_code_ == http::ErrorCode::none)
+	{
+		std::ifstream file(path, std::ios::binary);
+		std::stringstream content;
+		content << file.rdbuf();
+
+		EXPECT_EQ(resp.body_size_, resp.body_.size());
+		EXPECT_EQ(resp.body_, content.str());
+	}
+	std::remove(path);
+
+}
+
+TEST(BodySinkTests, CustomTest)
+{
+	auto writer = std::make_shared<CountingWriter>((size_t)-1);
+	auto resp = http::Get(http::URL{ "www.baidu.com" }, http::BodySink::Custom(writer));
+
+	if (resp.error_code_ == http::ErrorCode::none)
+	{
+		EXPECT_EQ(resp.body_size_, writer->written_);
+	}
+
+	// stopped at the first chunk
+	writer = std::make_shared<CountingWriter>(1);
+	resp = http::Get(http::URL{ "www.baidu.com" }, http::BodySink::Custom(writer));
+
+	if (resp.error_code_ != http::ErrorCode::curl)
+	{
+		EXPECT_EQ(http::ErrorCode::stopped, resp.error_code_);
+	}
+
+}
@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+
+#include <http/http.h>
+
+#include "local.h"
+
+
+
+TEST(BufferPoolTests, RecycleTest)
+{
+	http::BufferPoolConfig config;
+	config.max_retained_bytes_ = 1 << 20;
+	http::SetBufferPool(config);
+
+	LocalFile file("http_buffer_pool.bin", 5000);
+
+	// the first body misses, the recycled buffer serves the rest
+	auto before = http::GetBufferPoolStats();
+	for (int i = 0; i < 3; ++i)
+	{
+		auto resp = http::Get(http::URL{ file.URL() });
+		EXPECT_EQ(5000u, resp.body_.size());
+		http::Recycle(HTTP_MOVE(resp));
+		EXPECT_TRUE(resp.body_.empty());
+	}
+	auto after = http::GetBufferPoolStats();
+
+	EXPECT_EQ(before.misses_ + 1, after.misses_);
+	EXPECT_EQ(before.hits_ + 2, after.hits_);
+	EXPECT_EQ(before.recycled_ + 3, after.recycled_);
+	EXPECT_LE(8192u, after.retained_bytes_);
+
+	http::SetBufferPool(http::BufferPoolConfig());
+	EXPECT_EQ(0u, http::GetBufferPoolStats().retained_bytes_);
+
+}
+
+TEST(BufferPoolTests, CapTest)
+{
+	http::BufferPoolConfig config;
+	config.max_retained_bytes_ = 16 * 1024;
+	http::SetBufferPool(config);
+
+	auto before = http::GetBufferPoolStats();
+	for (int i = 0; i < 3; ++i)
+	{
+		std::string body;
+		body.reserve(8 * 1024);
+		http::Recycle(HTTP_MOVE(body));
+	}
+	auto after = http::GetBufferPoolStats();
+
+	// the third one is over the cap
+	EXPECT_EQ(before.recycled_ + 2, after.recycled_);
+	EXPECT_EQ(before.dropped_ + 1, after.dropped_);
+	EXPECT_GE(config.max_retained_bytes_, after.retained_bytes_);
+
+	http::SetBufferPool(http::BufferPoolConfig());
+
+	// the pool is off, nothing is kept
+	std::string body;
+	body.reserve(8 * 1024);
+	http::Recycle(HTTP_MOVE(body));
+	EXPECT_EQ(0u, http::GetBufferPoolStats().retained_bytes_);
+
+}
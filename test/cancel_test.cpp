@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include <http/http.h>
+
+#include "local.h"
+
+
+
+TEST(CancelTests, CancelledTokenTest)
+{
+	LocalServer server;
+	http::CancelToken token;
+	token.Cancel();
+
+	auto resp = http::Get(http::URL{ server.URL("/sleep/2000") }, token);
+
+	EXPECT_TRUE(token.Cancelled());
+	EXPECT_EQ(http::ErrorCode::cancelled, resp.error_code_);
+
+}
+
+TEST(CancelTests, CancelSyncTest)
+{
+	LocalServer server;
+	http::CancelToken token;
+
+	// the next progress callback aborts the transfer, long before the server answers
+	auto start = std::chrono::steady_clock::now();
+	auto resp = http::Get(http::URL{ server.URL("/sleep/2000") }, token, http::Progress{ [token](double progress) mutable {
+		token.Cancel();
+	} });
+
+	EXPECT_EQ(http::ErrorCode::cancelled, resp.error_code_);
+	EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(1500));
+
+}
+
+TEST(CancelTests, CancelAsyncTest)
+{
+	LocalServer server;
+	http::EngineConfig config;
+	config.max_transfers_ = 1;
+	http::Engine engine(config);
+
+	// one transfer waits on the server, the others wait in the queue
+	http::CancelToken token;
+	std::vector<http::Future<http::Response>> futures;
+	for (int i = 0; i < 5; ++i)
+	{
+		futures.push_back(engine.Request(http::Method::get, http::URL{ server.URL("/sleep/2000") }, token));
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	token.Cancel();
+
+	for (auto& future : futures)
+	{
+		auto resp = future.Get();
+		EXPECT_EQ(http::ErrorCode::cancelled, resp.error_code_);
+		EXPECT_EQ(-1, resp.code_);
+	}
+	EXPECT_EQ(0u, engine.InFlightCount());
+
+	// later requests fail before they start
+	auto resp = engine.Request(http::Method::get, http::URL{ server.URL("/sleep/2000") }, token).Get();
+	EXPECT_EQ(http::ErrorCode::cancelled, resp.error_code_);
+
+}
+
+TEST(CancelTests, DeadlineTest)
+{
+	LocalServer server;
+	auto passed = http::Deadline{ std::chrono::steady_clock::now() - std::chrono::milliseconds(1) };
+
+	auto resp = http::Get(http::URL{ server.URL("/sleep/2000") }, passed);
+	EXPECT_EQ(http::ErrorCode::deadline, resp.error_code_);
+
+	auto async_resp = http::async::Get(http::URL{ server.URL("/sleep/2000") }, passed).Get();
+	EXPECT_EQ(http::ErrorCode::deadline, async_resp.error_code_);
+
+	// passes while the server sleeps
+	auto soon = http::Deadline{ std::chrono::steady_clock::now() + std::chrono::milliseconds(100) };
+	auto resp_late = http::Get(http::URL{ server.URL("/sleep/2000") }, soon);
+	EXPECT_EQ(http::ErrorCode::deadline, resp_late.error_code_);
+
+	soon = http::Deadline{ std::chrono::steady_clock::now() + std::chrono::milliseconds(100) };
+	auto async_resp_late = http::async::Get(http::URL{ server.URL("/sleep/2000") }, soon).Get();
+	EXPECT_EQ(http::ErrorCode::deadline, async_resp_late.error_code_);
+
+	auto resp_in_time = http::Get(http::URL{ server.URL("/sleep/10") }, http::Deadline{ std::chrono::steady_clock::now() + std::chrono::seconds(30) });
+	EXPECT_EQ(http::ErrorCode::none, resp_in_time.error_code_);
+	EXPECT_EQ(200, resp_in_time.code_);
+
+}
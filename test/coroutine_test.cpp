@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+
+#include <http/http.h>
+
+#if HTTP_HAS_COROUTINE
+
+#include <atomic>
+
+static http::Task<int> GetTwice()
+{
+	auto first = co_await http::co::Get(http::URL{ "www.baidu.com" });
+	auto second = co_await http::co::Get(http::URL{ "www.baidu.com" });
+	co_return (int)(first.body_.size() + second.body_.size() > 0 ? 2 : 1);
+}
+
+TEST(CoroutineTests, AwaitTest)
+{
+	auto count = GetTwice().Get();
+
+	EXPECT_GT(count, 0);
+
+}
+
+TEST(CoroutineTests, PostTest)
+{
+	auto resp = http::co::Post(
+		http::URL{ "www.baidu.com" },
+		http::Payload{ "payload" }
+	).Get();
+
+	EXPECT_EQ(1, 1);
+
+}
+
+TEST(CoroutineTests, SpawnTest)
+{
+	std::atomic<int> completed{ 0 };
+
+	for (int i = 0; i < 50; ++i)
+	{
+		http::co::Spawn([](std::atomic<int>& completed) -> http::Task<int> {
+			co_await http::co::Head(http::URL{ "www.qq.com" });
+			++completed;
+			co_return 0;
+		}(completed));
+	}
+
+	while (completed.load() < 50)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	EXPECT_EQ(50, completed.load());
+
+}
+
+#endif // HTTP_HAS_COROUTINE
@@ -0,0 +1,569 @@
+#include <gtest/gtest.h>
+
+#include <http/http.h>
+
+#include "local.h"
+
+#include <atomic>
+#include <deque>
+
+
+
+TEST(EngineTests, ConcurrentTest)
+{
+	LocalServer server;
+	std::atomic<int> completed{ 0 };
+	std::vector<std::future<void>> futures;
+
+	for (int i = 0; i < 100; ++i)
+	{
+		futures.push_back(http::GetAsync([&completed](http::Response resp) {
+			if (resp.error_code_ == http::ErrorCode::none && resp.body_ == "ok")
+			{
+				++completed;
+			}
+		}, http::URL{ server.URL("/sleep/300") }));
+	}
+
+	// all of them wait on the server at once
+	EXPECT_LE(100u, http::Engine::Default().InFlightCount());
+
+	auto start = std::chrono::steady_clock::now();
+	for (auto& future : futures)
+	{
+		future.get();
+	}
+
+	EXPECT_EQ(100, completed.load());
+	EXPECT_EQ(0u, http::Engine::Default().InFlightCount());
+	EXPECT_GT(std::chrono::milliseconds(3000), std::chrono::steady_clock::now() - start);
+
+}
+
+TEST(EngineTests, OwnEngineTest)
+{
+	LocalServer server;
+	http::Engine engine;
+
+	http::Response received;
+	auto future = engine.Submit(http::Method::post, [&received](http::Response resp) {
+		received = HTTP_MOVE(resp);
+	}, http::URL{ server.URL("/echo") }, http::Payload{ "payload" });
+
+	future.get();
+
+	EXPECT_EQ(http::ErrorCode::none, received.error_code_);
+	EXPECT_EQ(200, received.code_);
+	EXPECT_EQ(0u, received.body_.find("POST /echo"));
+	EXPECT_NE(std::string::npos, received.body_.find("\r\n\r\npayload"));
+
+}
+
+TEST(EngineTests, CallbackExceptionTest)
+{
+	LocalServer server;
+	auto future = http::GetAsync([](http::Response resp) {
+		throw std::runtime_error("callback");
+	}, http::URL{ server.URL("/sleep/50") });
+
+	EXPECT_THROW(future.get(), std::runtime_error);
+
+}
+
+TEST(EngineTests, ShardedTest)
+{
+	LocalServer server;
+	http::EngineConfig config;
+	config.threads_ = 4;
+	http::Engine engine(config);
+
+	std::atomic<int> completed{ 0 };
+	std::vector<std::future<void>> futures;
+
+	// two origins on the same server
+	for (auto host : { "127.0.0.1", "localhost" })
+	{
+		for (int i = 0; i < 20; ++i)
+		{
+			futures.push_back(engine.Submit(http::Method::get, [&completed](http::Response resp) {
+				if (resp.error_code_ == http::ErrorCode::none)
+				{
+					++completed;
+				}
+			}, http::URL{ server.URL("/sleep/500", host) }, http::Headers{ { "Accept", "*/*" } }));
+		}
+	}
+
+	// every transfer is on a multi handle while the server sleeps
+	std::this_thread::sleep_for(std::chrono::milliseconds(250));
+	auto stats = engine.Stats();
+	EXPECT_EQ(40u, stats.in_flight_);
+	EXPECT_EQ(40u, stats.streams_);
+	EXPECT_EQ(2u, stats.origins_.size());
+
+	for (auto& future : futures)
+	{
+		future.get();
+	}
+
+	EXPECT_EQ(40, completed.load());
+	EXPECT_EQ(40u, engine.Stats().completed_);
+
+	// the loops are running, configuration is fixed
+	EXPECT_FALSE(engine.Configure(config));
+
+}
+
+TEST(EngineTests, QueueRejectTest)
+{
+	LocalServer server;
+	http::EngineConfig config;
+	config.max_transfers_ = 1;
+	config.queue_capacity_ = 2;
+	config.queue_policy_ = http::QueuePolicy::reject;
+	http::Engine engine(config);
+
+	std::atomic<int> rejected{ 0 };
+	std::atomic<int> completed{ 0 };
+	std::vector<std::future<void>> futures;
+
+	for (int i = 0; i < 20; ++i)
+	{
+		futures.push_back(engine.Submit(http::Method::get, [&](http::Response resp) {
+			if (resp.error_code_ == http::ErrorCode::rejected)
+			{
+				++rejected;
+			}
+			else if (resp.error_code_ == http::ErrorCode::none)
+			{
+				++completed;
+			}
+		}, http::URL{ server.URL("/sleep/200") }));
+	}
+
+	// one transfer waits on the server, two in the queue, the rest are turned away at once
+	auto stats = engine.Stats();
+	EXPECT_GE(3u, stats.in_flight_);
+	EXPECT_EQ(2u, stats.queued_peak_);
+
+	for (auto& future : futures)
+	{
+		future.get();
+	}
+
+	stats = engine.Stats();
+	EXPECT_LE(17, rejected.load());
+	EXPECT_EQ(20, rejected.load() + completed.load());
+	EXPECT_EQ((uint64_t)rejected.load(), stats.rejected_);
+	EXPECT_EQ(2u, stats.queued_peak_);
+	EXPECT_EQ(0u, stats.queued_);
+
+}
+
+TEST(EngineTests, QueueDropOldestTest)
+{
+	LocalServer server;
+	http::EngineConfig config;
+	config.max_transfers_ = 1;
+	config.queue_capacity_ = 2;
+	config.queue_policy_ = http::QueuePolicy::drop_oldest;
+	http::Engine engine(config);
+
+	std::vector<http::Future<http::Response>> futures;
+	for (int i = 0; i < 20; ++i)
+	{
+		futures.push_back(engine.Request(http::Method::get, http::URL{ server.URL("/sleep/200") }));
+	}
+
+	// one transfer waits on the server, the newest two are in the queue
+	EXPECT_GE(3u, engine.InFlightCount());
+
+	size_t dropped = 0;
+	for (size_t i = 0; i < futures.size(); ++i)
+	{
+		auto resp = futures[i].Get();
+		if (resp.error_code_ == http::ErrorCode::dropped)
+		{
+			++dropped;
+		}
+		else
+		{
+			EXPECT_EQ(http::ErrorCode::none, resp.error_code_);
+		}
+
+		// the newest requests are never the ones dropped
+		if (i >= futures.size() - 2)
+		{
+			EXPECT_EQ(http::ErrorCode::none, resp.error_code_);
+		}
+	}
+
+	EXPECT_LE(17u, dropped);
+	EXPECT_EQ(dropped, engine.Stats().dropped_);
+
+}
+
+TEST(EngineTests, QueueBlockTest)
+{
+	LocalServer server;
+	http::EngineConfig config;
+	config.max_transfers_ = 1;
+	config.queue_capacity_ = 2;
+	config.queue_policy_ = http::QueuePolicy::block;
+	http::Engine engine(config);
+
+	std::atomic<int> completed{ 0 };
+	std::vector<std::future<void>> futures;
+
+	// the submissions past the queue wait for the transfers ahead of them
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < 10; ++i)
+	{
+		futures.push_back(engine.Submit(http::Method::get, [&completed](http::Response resp) {
+			if (resp.error_code_ == http::ErrorCode::none)
+			{
+				++completed;
+			}
+		}, http::URL{ server.URL("/sleep/50") }));
+	}
+	EXPECT_LT(std::chrono::milliseconds(250), std::chrono::steady_clock::now() - start);
+
+	for (auto& future : futures)
+	{
+		future.get();
+	}
+
+	auto stats = engine.Stats();
+	EXPECT_EQ(10, completed.load());
+	EXPECT_EQ(2u, stats.queued_peak_);
+	EXPECT_LT(0u, stats.blocked_);
+	EXPECT_EQ(10u, stats.dequeued_);
+
+}
+
+TEST(EngineTests, PriorityTest)
+{
+	LocalServer server;
+	http::EngineConfig config;
+	config.max_transfers_ = 1;
+	http::Engine engine(config);
+
+	std::mutex mutex;
+	std::vector<http::Priority> order;
+	std::vector<std::future<void>> futures;
+
+	auto submit = [&](http::Priority priority) {
+		futures.push_back(engine.Submit(http::Method::get, [&, priority](http::Response resp) {
+			std::lock_guard<std::mutex> lock(mutex);
+			order.push_back(priority);
+		}, http::URL{ server.URL("/sleep/50") }, priority));
+	};
+
+	// the first one holds the only slot while the others queue
+	for (int i = 0; i < 10; ++i)
+	{
+		submit(http::Priority::low);
+	}
+	submit(http::Priority::high);
+	EXPECT_LE(9u, engine.Stats().priorities_[(size_t)http::Priority::low].queued_);
+
+	for (auto& future : futures)
+	{
+		future.get();
+	}
+
+	// overtakes the queued background requests
+	ASSERT_EQ(11u, order.size());
+	auto high = std::find(order.begin(), order.end(), http::Priority::high) - order.begin();
+	EXPECT_GE(1, high);
+
+	auto stats = engine.Stats();
+	EXPECT_EQ(10u, stats.priorities_[(size_t)http::Priority::low].dequeued_);
+	EXPECT_EQ(1u, stats.priorities_[(size_t)http::Priority::high].dequeued_);
+	EXPECT_EQ(0u, stats.priorities_[(size_t)http::Priority::normal].dequeued_);
+
+}
+
+TEST(EngineTests, OriginFairTest)
+{
+	LocalServer server;
+	http::EngineConfig config;
+	config.max_transfers_ = 2;
+	config.max_per_origin_ = 1;
+	http::Engine engine(config);
+
+	std::mutex mutex;
+	std::vector<std::string> order;
+	std::vector<std::future<void>> futures;
+
+	auto submit = [&](std::string host) {
+		futures.push_back(engine.Submit(http::Method::get, [&, host](http::Response resp) {
+			std::lock_guard<std::mutex> lock(mutex);
+			order.push_back(host);
+		}, http::URL{ server.URL("/sleep/100", host) }));
+	};
+
+	// two origins on the same server, one of them holds its only slot with a long queue
+	for (int i = 0; i < 10; ++i)
+	{
+		submit("127.0.0.1");
+	}
+	submit("localhost");
+
+	// the other origin takes the second slot at once
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	auto stats = engine.Stats();
+	EXPECT_EQ(2u, stats.streams_);
+	EXPECT_EQ(2u, stats.origins_.size());
+
+	for (auto& future : futures)
+	{
+		future.get();
+	}
+
+	// doesn't wait behind the queue of the other origin
+	ASSERT_EQ(11u, order.size());
+	auto other = std::find(order.begin(), order.end(), "localhost") - order.begin();
+	EXPECT_GE(1, other);
+
+}
+
+TEST(EngineTests, ExecutorTest)
+{
+	LocalServer server;
+
+	// a one thread pool
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<std::function<void()>> tasks;
+	bool stop = false;
+	size_t posted = 0;
+	std::thread worker([&] {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true)
+		{
+			cond.wait(lock, [&] { return stop || !tasks.empty(); });
+			if (tasks.empty())
+			{
+				break;
+			}
+			auto task = HTTP_MOVE(tasks.front());
+			tasks.pop_front();
+			lock.unlock();
+			task();
+			lock.lock();
+		}
+	});
+
+	{
+		http::EngineConfig config;
+		config.executor_ = [&](std::function<void()> task) {
+			std::lock_guard<std::mutex> lock(mutex);
+			tasks.push_back(HTTP_MOVE(task));
+			++posted;
+			cond.notify_one();
+		};
+		config.completion_batch_ = 4;
+		http::Engine engine(config);
+
+		std::atomic<int> on_worker{ 0 };
+		std::atomic<int> completed{ 0 };
+		std::vector<std::future<void>> futures;
+		for (int i = 0; i < 20; ++i)
+		{
+			futures.push_back(engine.Submit(http::Method::get, [&](http::Response resp) {
+				if (std::this_thread::get_id() == worker.get_id())
+				{
+					++on_worker;
+				}
+				if (resp.error_code_ == http::ErrorCode::none)
+				{
+					++completed;
+				}
+			}, http::URL{ server.URL("/sleep/100") }));
+		}
+
+		// nothing reaches the executor while the server sleeps
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		EXPECT_EQ(20u, engine.InFlightCount());
+		EXPECT_EQ(0u, engine.Stats().batches_);
+
+		for (auto& future : futures)
+		{
+			future.get();
+		}
+
+		EXPECT_EQ(20, on_worker.load());
+		EXPECT_EQ(20, completed.load());
+
+		auto stats = engine.Stats();
+		EXPECT_EQ(20u, stats.delivered_);
+		EXPECT_EQ(20u, stats.transferred_);
+		EXPECT_GE(stats.batches_, 5u);
+		EXPECT_LE(stats.batches_, 20u);
+		EXPECT_EQ(stats.batches_, posted);
+		EXPECT_GE(stats.callback_max_ns_ * stats.delivered_, stats.callback_ns_);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+		cond.notify_one();
+	}
+	worker.join();
+
+}
+
+TEST(EngineTests, OriginStatsTest)
+{
+	LocalServer server;
+
+	std::vector<http::EngineBackend> backends = { http::EngineBackend::poll };
+#ifdef __linux__
+	backends.push_back(http::EngineBackend::epoll);
+#endif
+	for (auto backend : backends)
+	{
+		// http/1.1 takes a connection per transfer, two at a time here, the rest wait in curl
+		http::EngineConfig config;
+		config.backend_ = backend;
+		config.max_connections_per_origin_ = 2;
+		http::Engine engine(config);
+
+		auto start = std::chrono::steady_clock::now();
+		std::vector<http::Future<http::Response>> futures;
+		for (int i = 0; i < 6; ++i)
+		{
+			futures.push_back(engine.Request(http::Method::get, http::URL{ server.URL("/sleep/300") }));
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(150));
+
+		auto stats = engine.Stats();
+		ASSERT_EQ(1u, stats.origins_.size());
+		EXPECT_EQ(server.URL(""), stats.origins_[0].origin_);
+		EXPECT_EQ(6u, stats.origins_[0].streams_);
+		EXPECT_EQ(backend == http::EngineBackend::epoll ? 2u : 0u, stats.origins_[0].connections_);
+		EXPECT_EQ(stats.origins_[0].connections_, stats.connections_);
+		EXPECT_EQ(6u, stats.streams_);
+
+		for (auto& future : futures)
+		{
+			EXPECT_EQ(http::ErrorCode::none, future.Get().error_code_);
+		}
+		// three rounds of two, no transfer waits for a connection that can't multiplex
+		EXPECT_GT(std::chrono::milliseconds(1500), std::chrono::steady_clock::now() - start);
+
+		// nothing left of the origin once its transfers are done
+		stats = engine.Stats();
+		EXPECT_TRUE(stats.origins_.empty());
+		EXPECT_EQ(0u, stats.connections_);
+		EXPECT_EQ(0u, stats.streams_);
+	}
+
+}
+
+TEST(EngineTests, MultiplexTest)
+{
+	LocalServer server;
+
+	// http/2 asked for over plain http, the local server answers over http/1.1
+	http::EngineConfig config;
+	config.backend_ = http::EngineBackend::epoll;
+	config.max_connections_per_origin_ = 2;
+	http::Engine engine(config);
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<http::Future<http::Response>> futures;
+	for (int i = 0; i < 6; ++i)
+	{
+		futures.push_back(engine.Request(http::Method::get, http::URL{ server.URL("/sleep/300") }, http::HttpVersion::http2));
+	}
+
+	// two connections at a time, none of the transfers waits for a stream that won't come
+	std::this_thread::sleep_for(std::chrono::milliseconds(150));
+	auto stats = engine.Stats();
+	EXPECT_EQ(6u, stats.streams_);
+#ifdef __linux__
+	EXPECT_EQ(2u, stats.connections_);
+#endif
+
+	for (auto& future : futures)
+	{
+		EXPECT_EQ(http::ErrorCode::none, future.Get().error_code_);
+	}
+	EXPECT_GT(std::chrono::milliseconds(1500), std::chrono::steady_clock::now() - start);
+
+	stats = engine.Stats();
+	EXPECT_EQ(0u, stats.multiplexed_);
+	EXPECT_EQ(6u, stats.connects_);
+	EXPECT_EQ(0u, stats.streams_);
+	EXPECT_TRUE(stats.origins_.empty());
+
+}
+
+TEST(EngineTests, StolenDeadlineTest)
+{
+	LocalServer server;
+
+	// every request lands on one loop, the other one steals from it
+	http::EngineConfig config;
+	config.threads_ = 2;
+	config.steal_threshold_ = 2;
+	config.max_transfers_ = 1;
+	http::Engine engine(config);
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<http::Future<http::Response>> futures;
+	for (int i = 0; i < 8; ++i)
+	{
+		futures.push_back(engine.Request(http::Method::get, http::URL{ server.URL("/sleep/3000") }, http::Deadline{ start + std::chrono::milliseconds(500) }));
+	}
+
+	for (auto& future : futures)
+	{
+		EXPECT_EQ(http::ErrorCode::deadline, future.Get().error_code_);
+	}
+
+	// the stolen ones expire on the loop that took them
+	auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	EXPECT_GT(1200, elapsed_ms);
+	EXPECT_LT(0u, engine.Stats().stolen_);
+
+}
+
+TEST(EngineTests, StolenCancelTest)
+{
+	LocalServer server;
+
+	// one running and seven queued on one loop, the other one steals the last three
+	http::EngineConfig config;
+	config.threads_ = 2;
+	config.steal_threshold_ = 7;
+	config.max_transfers_ = 1;
+	http::Engine engine(config);
+
+	http::CancelToken token;
+	std::vector<http::Future<http::Response>> futures;
+	for (int i = 0; i < 7; ++i)
+	{
+		futures.push_back(engine.Request(http::Method::get, http::URL{ server.URL("/sleep/3000") }, token));
+	}
+	// the thief starts this one first, the stolen ones with the token wait behind it
+	auto other = engine.Request(http::Method::get, http::URL{ server.URL("/sleep/1000") });
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	auto start = std::chrono::steady_clock::now();
+	token.Cancel();
+
+	for (auto& future : futures)
+	{
+		EXPECT_EQ(http::ErrorCode::cancelled, future.Get().error_code_);
+	}
+
+	// taken off the queue of the thief at once, not when they would start
+	auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	EXPECT_GT(300, elapsed_ms);
+	EXPECT_EQ(HTTP_OK, other.Get().code_);
+	EXPECT_LT(0u, engine.Stats().stolen_);
+
+}
@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+
+#include <http/http.h>
+
+#include "local.h"
+
+
+
+TEST(FutureTests, ThenTest)
+{
+	auto code = http::async::Get(
+		http::URL{ "www.baidu.com" }
+	).Then([](http::Response resp) {
+		return resp.code_;
+	}).Then([](int code) {
+		return code + 1;
+	}).Get();
+
+	EXPECT_NE(0, code);
+
+}
+
+TEST(FutureTests, VoidThenTest)
+{
+	bool called = false;
+
+	http::async::Head(
+		http::URL{ "www.qq.com" }
+	).Then([&called](http::Response resp) {
+		called = true;
+	}).Get();
+
+	EXPECT_TRUE(called);
+
+}
+
+TEST(FutureTests, ExceptionTest)
+{
+	auto future = http::async::Get(
+		http::URL{ "www.baidu.com" }
+	).Then([](http::Response resp) -> int {
+		throw std::runtime_error("then");
+	}).Then([](int code) {
+		// skipped
+		return code;
+	});
+
+	EXPECT_THROW(future.Get(), std::runtime_error);
+
+}
+
+TEST(FutureTests, WhenAllTest)
+{
+	std::vector<http::Future<http::Response>> futures;
+	for (int i = 0; i < 10; ++i)
+	{
+		futures.push_back(http::async::Get(http::URL{ "www.baidu.com" }));
+	}
+
+	auto responses = http::WhenAll(HTTP_MOVE(futures)).Get();
+
+	EXPECT_EQ(10u, responses.size());
+
+}
+
+TEST(FutureTests, WhenAnyTest)
+{
+	std::vector<http::Future<http::Response>> futures;
+	futures.push_back(http::async::Get(http::URL{ "www.baidu.com" }));
+	futures.push_back(http::async::Get(http::URL{ "www.qq.com" }));
+
+	auto first = http::WhenAny(HTTP_MOVE(futures)).Get();
+
+	EXPECT_LT(first.first, 2u);
+
+}
+
+TEST(FutureTests, CountedTest)
+{
+	LocalServer server;
+	http::Engine engine;
+
+	// registered before the transfer ends, so it runs as the waiters wake up
+	size_t in_flight = 1;
+	uint64_t completed = 0;
+	engine.Request(http::Method::get, http::URL{ server.URL("/sleep/50") }).Then([&](http::Response resp) {
+		in_flight = engine.InFlightCount();
+		completed = engine.Stats().completed_;
+		return resp.error_code_;
+	}).Get();
+
+	EXPECT_EQ(0u, in_flight);
+	EXPECT_EQ(1u, completed);
+	EXPECT_EQ(0u, engine.InFlightCount());
+
+}
+
+TEST(FutureTests, InvalidTest)
+{
+	auto first_state = std::make_shared<http::__future_state_t<int>>();
+	auto second_state = std::make_shared<http::__future_state_t<int>>();
+
+	// a default constructed future fails the whole set
+	std::vector<http::Future<int>> futures;
+	futures.push_back(http::Future<int>(first_state));
+	futures.push_back(http::Future<int>());
+	auto all = http::WhenAll(HTTP_MOVE(futures));
+
+	// and is skipped by the first ready one
+	futures.clear();
+	futures.push_back(http::Future<int>());
+	futures.push_back(http::Future<int>(second_state));
+	auto any = http::WhenAny(HTTP_MOVE(futures));
+
+	first_state->SetValue(1);
+	second_state->SetValue(2);
+	EXPECT_THROW(all.Get(), std::future_error);
+	auto first = any.Get();
+	EXPECT_EQ(1u, first.first);
+	EXPECT_EQ(2, first.second);
+
+	futures.clear();
+	futures.push_back(http::Future<int>());
+	EXPECT_THROW(http::WhenAny(HTTP_MOVE(futures)).Get(), std::future_error);
+
+}
+
+TEST(FutureTests, NoStateTest)
+{
+	http::Future<int> future;
+
+	EXPECT_FALSE(future.Valid());
+	EXPECT_FALSE(future.Ready());
+	EXPECT_THROW(future.Wait(), std::future_error);
+	EXPECT_THROW(future.Get(), std::future_error);
+	EXPECT_THROW(future.Then([](int value) { return value; }), std::future_error);
+
+	http::Future<void> done;
+	EXPECT_FALSE(done.Ready());
+	EXPECT_THROW(done.Get(), std::future_error);
+
+}
@@ -2,6 +2,8 @@
 
 #include <http/http.h>
 
+#include "local.h"
+
 
 
 TEST(GetTests, SampleGetTest)
@@ -37,3 +39,119 @@ TEST(GetTests, AsyncTest)
 
 
 }
+
+TEST(GetTests, PresizeTest)
+{
+	auto before = http::GetBufferStats();
+	auto resp = http::Get(http::URL{ "www.baidu.com" });
+	auto after = http::GetBufferStats();
+
+	// a chunked body grows as it arrives
+	if (resp.error_code_ == http::ErrorCode::none && !resp.headers_.GetField<std::string>("Content-Length").empty())
+	{
+		EXPECT_EQ(before.presized_ + 1, after.presized_);
+		EXPECT_EQ(before.reallocations_, after.reallocations_);
+	}
+
+	// sized for the final body, not for the redirect before it
+	LocalServer server;
+	resp = http::Get(http::URL{ server.URL("/redirect/1000000/bytes/10") });
+
+	EXPECT_EQ(http::ErrorCode::none, resp.error_code_);
+	EXPECT_EQ(std::string(10, 'x'), resp.body_);
+	EXPECT_GT(1000000u, resp.body_.capacity());
+
+}
+
+TEST(GetTests, OnDataTest)
+{
+	LocalServer server;
+
+	// every chunk goes to the callback, none of it to the body
+	size_t received = 0;
+	size_t chunks = 0;
+	auto resp = http::Get(http::URL{ server.URL("/bytes/300000") }, http::OnData{ [&](const char* data, size_t size) {
+		received += size;
+		++chunks;
+		return true;
+	} });
+
+	EXPECT_EQ(http::ErrorCode::none, resp.error_code_);
+	EXPECT_EQ(200, resp.code_);
+	EXPECT_EQ(300000u, received);
+	EXPECT_LT(1u, chunks);
+	EXPECT_TRUE(resp.body_.empty());
+
+	// stopped at the first chunk
+	chunks = 0;
+	resp = http::Get(http::URL{ server.URL("/bytes/300000") }, http::OnData{ [&chunks](const char* data, size_t size) {
+		++chunks;
+		return false;
+	} });
+
+	EXPECT_EQ(http::ErrorCode::stopped, resp.error_code_);
+	EXPECT_EQ(1u, chunks);
+	EXPECT_TRUE(resp.body_.empty());
+
+}
+
+TEST(GetTests, MaxBytesTest)
+{
+	LocalServer server;
+
+	// rejected from the Content-Length before any of the body is kept
+	auto resp = http::Get(http::URL{ server.URL("/bytes/1000") }, http::MaxBodyBytes{ 500 });
+
+	EXPECT_EQ(http::ErrorCode::too_large, resp.error_code_);
+	EXPECT_TRUE(resp.body_.empty());
+
+	// a chunked body has no Content-Length, it is rejected once the running total passes the limit
+	resp = http::Get(http::URL{ server.URL("/chunked/1000") }, http::MaxBodyBytes{ 500 });
+
+	EXPECT_EQ(http::ErrorCode::too_large, resp.error_code_);
+	EXPECT_LT(0u, resp.body_.size());
+	EXPECT_GE(500u, resp.body_.size());
+
+	// a length past what long long holds is still too large, not cut short at its first digits
+	resp = http::Get(http::URL{ server.URL("/length/12345678901") }, http::MaxBodyBytes{ 2000000000 });
+
+	EXPECT_EQ(http::ErrorCode::too_large, resp.error_code_);
+
+	resp = http::Get(http::URL{ server.URL("/length/99999999999999999999999") }, http::MaxBodyBytes{ 2000000000 });
+
+	EXPECT_EQ(http::ErrorCode::too_large, resp.error_code_);
+
+	resp = http::Get(http::URL{ server.URL("/headers/2000") }, http::MaxHeaderBytes{ 1000 });
+
+	EXPECT_EQ(http::ErrorCode::too_large, resp.error_code_);
+
+	// room for all of it
+	resp = http::Get(http::URL{ server.URL("/chunked/1000") }, http::MaxBodyBytes{ 1000 }, http::MaxHeaderBytes{ 1000 });
+
+	EXPECT_EQ(http::ErrorCode::none, resp.error_code_);
+	EXPECT_EQ(std::string(1000, 'x'), resp.body_);
+
+	resp = http::Get(http::URL{ server.URL("/headers/500") }, http::MaxBodyBytes{ 1000 }, http::MaxHeaderBytes{ 1000 });
+
+	EXPECT_EQ(http::ErrorCode::none, resp.error_code_);
+	EXPECT_EQ("ok", resp.body_);
+
+}
+
+TEST(GetTests, MaxBytesRedirectTest)
+{
+	LocalServer server;
+
+	// only the Content-Length of the final response counts
+	auto resp = http::Get(http::URL{ server.URL("/redirect/1000/bytes/10") }, http::MaxBodyBytes{ 500 });
+
+	EXPECT_EQ(http::ErrorCode::none, resp.error_code_);
+	EXPECT_EQ(200, resp.code_);
+	EXPECT_EQ(std::string(10, 'x'), resp.body_);
+
+	resp = http::Get(http::URL{ server.URL("/redirect/10/bytes/1000") }, http::MaxBodyBytes{ 500 });
+
+	EXPECT_EQ(http::ErrorCode::too_large, resp.error_code_);
+	EXPECT_TRUE(resp.body_.empty());
+
+}
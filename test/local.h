@@ -0,0 +1,303 @@
+#pragma once
+
+// local fixtures for the tests that must not depend on public hosts
+
+#include <http/http.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+// winsock2.h is included by curl.h
+typedef int socklen_t;
+#define __local_close closesocket
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#define __local_close close
+#endif
+
+// a client that gave up must not kill the test with SIGPIPE
+#ifdef MSG_NOSIGNAL
+#define __local_send_flags MSG_NOSIGNAL
+#else
+#define __local_send_flags 0
+#endif
+
+
+
+// size bytes of 'x' in a temporary file, removed with the object
+class LocalFile
+{
+public:
+
+	LocalFile(const std::string& name, size_t size)
+	{
+		// file:// needs an absolute path
+#ifdef _WIN32
+		auto dir = std::getenv("TEMP");
+		_path = std::string(dir ? dir : "C:\\Windows\\Temp") + "\\" + name;
+		_url = "file:///" + _path;
+		std::replace(_url.begin(), _url.end(), '\\', '/');
+#else
+		_path = "/tmp/" + name;
+		_url = "file://" + _path;
+#endif
+		std::ofstream file(_path, std::ios::trunc | std::ios::binary);
+		std::string chunk((std::min)(size, (size_t)1 << 20), 'x');
+		for (size_t written = 0; written < size; written += chunk.size())
+		{
+			file.write(chunk.data(), (std::min)(chunk.size(), size - written));
+		}
+	}
+
+	~LocalFile()
+	{
+		std::remove(_path.c_str());
+	}
+
+	std::string URL() const { return _url; }
+
+private:
+
+	std::string _path;
+	std::string _url;
+};
+
+// a blocking http/1.1 server on 127.0.0.1, one connection per request
+//   /sleep/<ms>          200 "ok" after ms milliseconds
+//   /bytes/<n>           200 with n bytes of 'x'
+//   /chunked/<n>         200 with n bytes of 'x' in chunks of 100, no Content-Length
+//   /headers/<n>         200 with an n byte X-Fill header
+//   /length/<n>          200 with a Content-Length of n and 10 bytes of 'x', n may not fit any integer
+//   /redirect/<n>/<to>   302 to /<to> with an n byte body
+//   /echo                200 with the request as it was received
+class LocalServer
+{
+public:
+
+	LocalServer()
+	{
+#ifdef _WIN32
+		WSADATA data;
+		WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+		_listen = socket(AF_INET, SOCK_STREAM, 0);
+		int reuse = 1;
+		setsockopt(_listen, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = 0;
+		bind(_listen, (struct sockaddr*)&addr, sizeof(addr));
+		listen(_listen, 128);
+
+		socklen_t length = sizeof(addr);
+		getsockname(_listen, (struct sockaddr*)&addr, &length);
+		_port = ntohs(addr.sin_port);
+
+		_thread = std::thread(&LocalServer::__accept, this);
+	}
+
+	~LocalServer()
+	{
+		_stop = true;
+		_thread.join();
+		for (auto& client : _clients)
+		{
+			client.join();
+		}
+		__local_close(_listen);
+#ifdef _WIN32
+		WSACleanup();
+#endif
+	}
+
+	// the same server under another host name, for per host limits
+	std::string URL(const std::string& path, const std::string& host = "127.0.0.1") const
+	{
+		return "http://" + host + ":" + std::to_string(_port) + path;
+	}
+
+private:
+
+	void __accept()
+	{
+		while (!_stop)
+		{
+			fd_set read_set;
+			FD_ZERO(&read_set);
+			FD_SET(_listen, &read_set);
+			struct timeval timeout = { 0, 20 * 1000 };
+			if (select((int)_listen + 1, &read_set, nullptr, nullptr, &timeout) <= 0)
+			{
+				continue;
+			}
+
+			auto client = accept(_listen, nullptr, nullptr);
+			if (client != CURL_SOCKET_BAD)
+			{
+				_clients.emplace_back(&LocalServer::__serve, this, client);
+			}
+		}
+	}
+
+	void __serve(curl_socket_t client)
+	{
+		std::string request;
+		char buffer[4096];
+		while (request.find("\r\n\r\n") == std::string::npos)
+		{
+			auto size = recv(client, buffer, sizeof(buffer), 0);
+			if (size <= 0)
+			{
+				__local_close(client);
+				return;
+			}
+			request.append(buffer, size);
+		}
+
+		// the body of a request with a Content-Length
+		auto header_end = request.find("\r\n\r\n") + 4;
+		auto length_pos = request.find("Content-Length: ");
+		if (length_pos != std::string::npos && length_pos < header_end)
+		{
+			size_t length = std::atoi(request.c_str() + length_pos + 16);
+			while (request.size() < header_end + length)
+			{
+				auto size = recv(client, buffer, sizeof(buffer), 0);
+				if (size <= 0)
+				{
+					break;
+				}
+				request.append(buffer, size);
+			}
+		}
+
+		// "GET /path?query HTTP/1.1"
+		auto method = request.substr(0, request.find(' '));
+		auto begin = request.find(' ') + 1;
+		auto path = request.substr(begin, request.find_first_of("? ", begin) - begin);
+
+		std::string status = "200 OK";
+		std::string headers;
+		std::string body;
+		bool chunked = false;
+		std::string length;
+		if (path.compare(0, 7, "/sleep/") == 0)
+		{
+			// the connection may be given up meanwhile, the sleep ends with the server
+			auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::atoi(path.c_str() + 7));
+			while (!_stop && std::chrono::steady_clock::now() < until)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(5));
+			}
+			body = "ok";
+		}
+		else if (path.compare(0, 7, "/bytes/") == 0)
+		{
+			body.assign(std::atoi(path.c_str() + 7), 'x');
+		}
+		else if (path.compare(0, 9, "/chunked/") == 0)
+		{
+			body.assign(std::atoi(path.c_str() + 9), 'x');
+			chunked = true;
+		}
+		else if (path.compare(0, 9, "/headers/") == 0)
+		{
+			headers = "X-Fill: " + std::string(std::atoi(path.c_str() + 9), 'h') + "\r\n";
+			body = "ok";
+		}
+		else if (path.compare(0, 8, "/length/") == 0)
+		{
+			length = path.substr(8);
+			body.assign(10, 'x');
+		}
+		else if (path.compare(0, 10, "/redirect/") == 0)
+		{
+			auto to = path.find('/', 10);
+			status = "302 Found";
+			headers = "Location: " + path.substr(to) + "\r\n";
+			body.assign(std::atoi(path.c_str() + 10), 'r');
+		}
+		else if (path == "/echo")
+		{
+			body = request;
+		}
+		else
+		{
+			status = "404 Not Found";
+		}
+
+		if (chunked)
+		{
+			headers += "Transfer-Encoding: chunked\r\n";
+		}
+		else
+		{
+			headers += "Content-Length: " + (length.empty() ? std::to_string(body.size()) : length) + "\r\n";
+		}
+		auto response = "HTTP/1.1 " + status + "\r\n" + headers + "Connection: close\r\n\r\n";
+		if (method == "HEAD")
+		{
+			__send(client, response);
+		}
+		else if (chunked)
+		{
+			// one write per chunk, so the client sees the body grow
+			__send(client, response);
+			for (size_t offset = 0; offset < body.size(); offset += 100)
+			{
+				auto chunk = body.substr(offset, 100);
+				char size[16];
+				snprintf(size, sizeof(size), "%zx\r\n", chunk.size());
+				if (!__send(client, size + chunk + "\r\n"))
+				{
+					break;
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			__send(client, "0\r\n\r\n");
+		}
+		else
+		{
+			__send(client, response + body);
+		}
+		__local_close(client);
+	}
+
+	bool __send(curl_socket_t client, const std::string& data)
+	{
+		size_t sent = 0;
+		while (sent < data.size())
+		{
+			auto size = send(client, data.data() + sent, (int)(data.size() - sent), __local_send_flags);
+			if (size <= 0)
+			{
+				return false;
+			}
+			sent += size;
+		}
+		return true;
+	}
+
+private:
+
+	curl_socket_t _listen;
+	int _port = 0;
+	std::atomic<bool> _stop{ false };
+	std::thread _thread;
+	std::vector<std::thread> _clients;
+};
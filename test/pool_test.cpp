@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+
+#include <http/http.h>
+
+#include <thread>
+
+#include "local.h"
+
+
+
+TEST(PoolTests, ReuseHandle)
+{
+	LocalServer server;
+	http::Pool pool(2, 1);
+
+	{
+		// the handle is borrowed for the request only
+		http::Session session(pool);
+		EXPECT_EQ(0, pool.InUseCount());
+		session.Prepare(http::URL{ server.URL("/bytes/10") });
+		EXPECT_EQ(http::ErrorCode::none, session.Get().error_code_);
+		EXPECT_EQ(0, pool.InUseCount());
+		EXPECT_EQ(1, pool.IdleCount());
+
+		// warm handle is reused
+		session.Prepare(http::URL{ server.URL("/bytes/10") }, http::Headers{ { "Accept", "*/*" } });
+		EXPECT_EQ(http::ErrorCode::none, session.Get().error_code_);
+		EXPECT_EQ(1, pool.IdleCount());
+	}
+
+	EXPECT_EQ(0, pool.InUseCount());
+	EXPECT_EQ(1, pool.IdleCount());
+
+	pool.Clear();
+	EXPECT_EQ(0, pool.IdleCount());
+}
+
+TEST(PoolTests, IdleEviction)
+{
+	LocalServer server;
+	http::Pool pool(4, 1, 100);
+
+	{
+		http::Session session(pool);
+		session.Prepare(http::URL{ server.URL("/bytes/10") });
+		session.Get();
+	}
+	EXPECT_EQ(1, pool.IdleCount());
+
+	// expired handles are closed when the pool is looked at, not only on the next request
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	EXPECT_EQ(0, pool.IdleCount());
+
+}
+
+TEST(PoolTests, HostWaitTest)
+{
+	LocalServer server;
+	http::Pool pool(2, 1);
+
+	auto slow = [&pool, &server] {
+		http::Session session(pool);
+		session.Prepare(http::URL{ server.URL("/sleep/1000") });
+		session.Get();
+	};
+	std::thread first(slow);
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	std::thread second(slow);
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	// the second session waits for its host without a handle
+	EXPECT_EQ(1, pool.InUseCount());
+
+	// and without keeping another host out
+	auto start = std::chrono::steady_clock::now();
+	http::Session session(pool);
+	session.Prepare(http::URL{ server.URL("/bytes/10", "localhost") });
+	auto resp = session.Get();
+	auto elapsed = std::chrono::steady_clock::now() - start;
+
+	EXPECT_EQ(http::ErrorCode::none, resp.error_code_);
+	EXPECT_GT(std::chrono::milliseconds(500), elapsed);
+
+	first.join();
+	second.join();
+}
+
+TEST(PoolTests, MaxTotalTest)
+{
+	LocalServer server;
+	http::Pool pool(1, 2);
+
+	// two hosts, one handle, the second request waits for it
+	std::thread first([&pool, &server] {
+		http::Session session(pool);
+		session.Prepare(http::URL{ server.URL("/sleep/500") });
+		session.Get();
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	EXPECT_EQ(1, pool.InUseCount());
+
+	auto start = std::chrono::steady_clock::now();
+	http::Session session(pool);
+	session.Prepare(http::URL{ server.URL("/bytes/10", "localhost") });
+	auto resp = session.Get();
+
+	EXPECT_EQ(http::ErrorCode::none, resp.error_code_);
+	EXPECT_LT(std::chrono::milliseconds(300), std::chrono::steady_clock::now() - start);
+	EXPECT_EQ(0, pool.InUseCount());
+	EXPECT_GE(1u, pool.IdleCount());
+
+	first.join();
+}
+
+TEST(PoolTests, SampleGetTest)
+{
+
+	auto resp = http::Get(
+		http::URL{ "www.baidu.com" }
+	);
+
+	resp = http::Get(
+		http::URL{ "www.baidu.com" }
+	);
+
+	EXPECT_EQ(0, http::Pool::Default().InUseCount());
+
+}
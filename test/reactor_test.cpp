@@ -0,0 +1,223 @@
+#include <gtest/gtest.h>
+
+#include <http/http.h>
+
+#include <atomic>
+#include <map>
+
+#include "local.h"
+
+
+
+// the host event loop, a plain select() loop
+struct HostLoop
+{
+	std::map<curl_socket_t, int> watched_;
+	bool timer_armed_ = false;
+	std::chrono::steady_clock::time_point timer_;
+	std::atomic<bool> woken_{ false };
+
+	http::ReactorHooks Hooks()
+	{
+		http::ReactorHooks hooks;
+		hooks.watch_ = [this](curl_socket_t socket, int events) {
+			if (events == http::Reactor::none)
+			{
+				watched_.erase(socket);
+			}
+			else
+			{
+				watched_[socket] = events;
+			}
+		};
+		hooks.timer_ = [this](long timeout_ms) {
+			timer_armed_ = timeout_ms >= 0;
+			timer_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+		};
+		hooks.wakeup_ = [this] {
+			woken_ = true;
+		};
+		return hooks;
+	}
+
+	void RunOnce(http::Reactor& reactor)
+	{
+		long wait_ms = 100;
+		if (timer_armed_)
+		{
+			auto left = std::chrono::duration_cast<std::chrono::milliseconds>(timer_ - std::chrono::steady_clock::now()).count();
+			wait_ms = (std::min)(wait_ms, (long)(std::max)(left, (decltype(left))0));
+		}
+
+		std::vector<std::pair<curl_socket_t, int>> ready;
+		if (watched_.empty())
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(wait_ms));
+		}
+		else
+		{
+			fd_set read_set, write_set, error_set;
+			FD_ZERO(&read_set);
+			FD_ZERO(&write_set);
+			FD_ZERO(&error_set);
+
+			curl_socket_t max_socket = 0;
+			for (auto& watched : watched_)
+			{
+				if (watched.second & http::Reactor::read) FD_SET(watched.first, &read_set);
+				if (watched.second & http::Reactor::write) FD_SET(watched.first, &write_set);
+				FD_SET(watched.first, &error_set);
+				max_socket = (std::max)(max_socket, watched.first);
+			}
+
+			struct timeval timeout;
+			timeout.tv_sec = wait_ms / 1000;
+			timeout.tv_usec = (wait_ms % 1000) * 1000;
+			if (select((int)max_socket + 1, &read_set, &write_set, &error_set, &timeout) > 0)
+			{
+				for (auto& watched : watched_)
+				{
+					int events = 0;
+					if (FD_ISSET(watched.first, &read_set)) events |= http::Reactor::read;
+					if (FD_ISSET(watched.first, &write_set)) events |= http::Reactor::write;
+					if (FD_ISSET(watched.first, &error_set)) events |= http::Reactor::error;
+					if (events)
+					{
+						ready.emplace_back(watched.first, events);
+					}
+				}
+			}
+		}
+
+		// the hooks change the watched sockets while the reactor runs
+		for (auto& socket : ready)
+		{
+			reactor.OnSocketReady(socket.first, socket.second);
+		}
+
+		if (woken_.exchange(false))
+		{
+			reactor.OnTimeout();
+		}
+		else if (timer_armed_ && std::chrono::steady_clock::now() >= timer_)
+		{
+			timer_armed_ = false;
+			reactor.OnTimeout();
+		}
+	}
+};
+
+TEST(ReactorTests, GetTest)
+{
+	HostLoop loop;
+	http::Reactor reactor(loop.Hooks());
+
+	std::thread::id completed_on;
+	auto future = reactor.Request(http::Method::get, http::URL{ "www.baidu.com" }).Then([&completed_on](http::Response resp) {
+		completed_on = std::this_thread::get_id();
+		return resp;
+	});
+
+	// curl asked for a timer to start the transfer
+	EXPECT_TRUE(loop.timer_armed_);
+	EXPECT_EQ(1u, reactor.InFlightCount());
+
+	while (reactor.InFlightCount() > 0)
+	{
+		loop.RunOnce(reactor);
+	}
+
+	// no thread of its own, the completion ran inside the loop
+	ASSERT_TRUE(future.Ready());
+	EXPECT_EQ(std::this_thread::get_id(), completed_on);
+
+	auto resp = future.Get();
+	if (resp.error_code_ == http::ErrorCode::none)
+	{
+		EXPECT_EQ(HTTP_OK, resp.code_);
+	}
+
+}
+
+TEST(ReactorTests, ManyTest)
+{
+	HostLoop loop;
+	http::Reactor reactor(loop.Hooks());
+
+	int completed = 0;
+	for (int i = 0; i < 10; ++i)
+	{
+		reactor.Submit(http::Method::get, [&completed](http::Response resp) {
+			++completed;
+		}, http::URL{ "www.baidu.com" });
+	}
+
+	while (reactor.InFlightCount() > 0)
+	{
+		loop.RunOnce(reactor);
+	}
+
+	EXPECT_EQ(10, completed);
+
+}
+
+TEST(ReactorTests, StoppedTest)
+{
+	HostLoop loop;
+	http::Reactor reactor(loop.Hooks());
+
+	http::CancelToken token;
+	token.Cancel();
+
+	// completes at once without a turn of the loop
+	auto future = reactor.Request(http::Method::get, http::URL{ "www.baidu.com" }, token);
+
+	ASSERT_TRUE(future.Ready());
+	EXPECT_EQ(http::ErrorCode::cancelled, future.Get().error_code_);
+	EXPECT_EQ(0u, reactor.InFlightCount());
+
+}
+
+TEST(ReactorTests, CancelStalledTest)
+{
+	LocalServer server;
+	HostLoop loop;
+	http::Reactor reactor(loop.Hooks());
+
+	// the server sends nothing, so no progress calls while the transfer waits
+	http::CancelToken token;
+	auto start = std::chrono::steady_clock::now();
+	auto future = reactor.Request(http::Method::get, http::URL{ server.URL("/sleep/3000") }, token);
+
+	std::thread canceller([token]() mutable {
+		// after the connect timers of curl have run out
+		std::this_thread::sleep_for(std::chrono::milliseconds(600));
+		token.Cancel();
+	});
+
+	while (reactor.InFlightCount() > 0)
+	{
+		loop.RunOnce(reactor);
+	}
+	canceller.join();
+
+	ASSERT_TRUE(future.Ready());
+	EXPECT_EQ(http::ErrorCode::cancelled, future.Get().error_code_);
+	EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(1500));
+	EXPECT_TRUE(loop.watched_.empty());
+
+}
+
+TEST(ReactorTests, DestroyTest)
+{
+	HostLoop loop;
+	http::Future<http::Response> future;
+	{
+		http::Reactor reactor(loop.Hooks());
+		future = reactor.Request(http::Method::get, http::URL{ "www.baidu.com" });
+	}
+
+	ASSERT_TRUE(future.Ready());
+	EXPECT_EQ(http::ErrorCode::aborted, future.Get().error_code_);
+
+}
@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+
+#include <http/http.h>
+
+#include "local.h"
+
+
+
+TEST(SessionTests, ResetTest)
+{
+	LocalServer server;
+	http::Session session;
+
+	session.Prepare(
+		http::URL{ server.URL("/echo") },
+		http::Headers{ { "X-Reset", "before" } },
+		http::Parameters{ { "reset", "before" } },
+		http::Payload{ "payload" }
+	);
+	auto resp = session.Post();
+
+	EXPECT_EQ(0u, resp.body_.find("POST /echo?reset=before "));
+	EXPECT_NE(std::string::npos, resp.body_.find("X-Reset: before"));
+	EXPECT_NE(std::string::npos, resp.body_.find("\r\n\r\npayload"));
+
+	// nothing of the previous request is left
+	session.Reset();
+	session.Reset();
+
+	http::URL url{ server.URL("/echo") };
+	session.SetOption(url);
+	resp = session.Get();
+
+	EXPECT_EQ(0u, resp.body_.find("GET /echo"));
+	EXPECT_EQ(std::string::npos, resp.body_.find("reset=before"));
+	EXPECT_EQ(std::string::npos, resp.body_.find("X-Reset"));
+	EXPECT_EQ(std::string::npos, resp.body_.find("payload"));
+	EXPECT_EQ(std::string::npos, resp.body_.find("Content-Length"));
+
+}
+
+TEST(SessionTests, ReuseTest)
+{
+	LocalFile file("http_session_reuse.bin", 3000);
+	http::Session session;
+
+	session.Prepare(http::URL{ file.URL() });
+	auto first = session.Get();
+
+	session.Prepare(http::URL{ file.URL() });
+	auto second = session.Get();
+
+	// the body is not appended to the previous one
+	EXPECT_EQ(3000u, first.body_.size());
+	EXPECT_EQ(first.body_, second.body_);
+
+}
@@ -0,0 +1,35 @@
+#include <gtest/gtest.h>
+
+#include <http/http.h>
+
+
+
+TEST(ShareTests, SessionShare)
+{
+	http::Share share;
+
+	auto resp = http::Get(
+		http::URL{ "www.baidu.com" },
+		share
+	);
+
+	resp = http::Get(
+		http::URL{ "www.baidu.com" },
+		share
+	);
+
+	// dns cache is looked up through the share
+	EXPECT_GT(share.LockStats(CURL_LOCK_DATA_DNS).acquired_, 0u);
+
+}
+
+TEST(ShareTests, DefaultShare)
+{
+
+	auto resp = http::Get(
+		http::URL{ "www.baidu.com" }
+	);
+
+	EXPECT_GT(http::Share::Default().LockStats(CURL_LOCK_DATA_DNS).acquired_, 0u);
+
+}